@@ -0,0 +1,299 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "format.h"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstring>
+
+/* Tooltip functions */
+static void tooltip_append_len(tooltip_t*, const gchar*, gsize);
+static void tooltip_append_row(tooltip_t*, const gchar*, gulong);
+static void tooltip_append_eta(tooltip_t*, gdouble);
+static void tooltip_append_rate(tooltip_t*, const gchar*, gulong);
+static void
+tooltip_gen_trend(tooltip_t*, const tooltip_source_t*, const gchar*);
+
+void tooltip_clear(tooltip_t* tooltip) {
+  tooltip->len     = 0;
+  tooltip->reserve = 0;
+  tooltip->buf[0]  = '\0';
+}
+
+void tooltip_append(tooltip_t* tooltip, const gchar* fmt, ...) {
+  gsize   left = sizeof(tooltip->buf) - tooltip->reserve - tooltip->len;
+  va_list args;
+  gint    len  = 0;
+
+  va_start(args, fmt);
+  len = g_vsnprintf(tooltip->buf + tooltip->len, left, fmt, args);
+  va_end(args);
+  if(len > 0 && (gsize)len < left)
+    tooltip->len += len;
+  else
+    tooltip->buf[tooltip->len] = '\0';
+}
+
+/* Like tooltip_append, but the len bytes of text are copied as they are */
+static void
+tooltip_append_len(tooltip_t* tooltip, const gchar* text, gsize len) {
+  gsize left = sizeof(tooltip->buf) - tooltip->reserve - tooltip->len;
+
+  if(len >= left)
+    return;
+  memcpy(tooltip->buf + tooltip->len, text, len);
+  tooltip->len += len;
+  tooltip->buf[tooltip->len] = '\0';
+}
+
+/* Appends the opening tag and keeps enough room for the closing tag so that
+   it can always be appended by tooltip_close_tag, however much is appended
+   in between. Returns FALSE if the tag was not appended */
+gboolean
+tooltip_open_tag(tooltip_t* tooltip, const gchar* open, const gchar* close) {
+  gsize left = sizeof(tooltip->buf) - tooltip->reserve - tooltip->len;
+
+  if(strlen(open) + strlen(close) >= left)
+    return FALSE;
+  tooltip_append_len(tooltip, open, strlen(open));
+  tooltip->reserve += strlen(close);
+  return TRUE;
+}
+
+void tooltip_close_tag(tooltip_t* tooltip, const gchar* close) {
+  tooltip->reserve -= strlen(close);
+  tooltip_append_len(tooltip, close, strlen(close));
+}
+
+/* Appends at most width characters of text, which may contain markup
+   characters. If pad is set, it is padded to width with spaces. Process
+   names need not be valid UTF-8, so invalid bytes are replaced rather than
+   having the whole markup rejected */
+void tooltip_append_escaped(tooltip_t*   tooltip,
+                            const gchar* text,
+                            guint        width,
+                            gboolean     pad) {
+  const gchar* p     = text;
+  const gchar* next  = NULL;
+  const gchar* out   = NULL;
+  gunichar     c     = 0;
+  guint        chars = 0;
+
+  for(chars = 0; *p && chars < width; chars++, p = next) {
+    c    = g_utf8_get_char_validated(p, -1);
+    next = g_utf8_next_char(p);
+    switch(c) {
+    case '&':
+      out = "&amp;";
+      break;
+    case '<':
+      out = "&lt;";
+      break;
+    case '>':
+      out = "&gt;";
+      break;
+    case '"':
+      out = "&quot;";
+      break;
+    case '\'':
+      out = "&apos;";
+      break;
+    case (gunichar)-1:
+    case (gunichar)-2:
+      out  = "\xef\xbf\xbd"; /* U+FFFD */
+      next = p + 1;
+      break;
+    default:
+      out = NULL;
+      break;
+    }
+    if(out)
+      tooltip_append_len(tooltip, out, strlen(out));
+    else
+      tooltip_append_len(tooltip, p, next - p);
+  }
+  if(pad && chars < width)
+    tooltip_append(tooltip, "%*s", (gint)(width - chars), "");
+}
+
+void tooltip_append_bytes(tooltip_t* tooltip, gulong bytes) {
+  const gchar* units = NULL;
+  gdouble      value = get_scaled(bytes, &units);
+
+  tooltip_append(tooltip, "%5.1f %s\n", value, units);
+}
+
+static void
+tooltip_append_row(tooltip_t* tooltip, const gchar* label, gulong bytes) {
+  tooltip_append(tooltip, "<b>%-*s</b>", (gint)format_app.tooltip.width,
+                 label);
+  tooltip_append_bytes(tooltip, bytes);
+}
+
+static void tooltip_append_eta(tooltip_t* tooltip, gdouble eta) {
+  if(eta < 120)
+    tooltip_append(tooltip, "~%.0f s", eta);
+  else if(eta < 7200)
+    tooltip_append(tooltip, "~%.0f min", eta / 60);
+  else
+    tooltip_append(tooltip, "~%.0f h", eta / 3600);
+}
+
+static void
+tooltip_append_rate(tooltip_t* tooltip, const gchar* label, gulong rate) {
+  tooltip_append(tooltip, "<b>%-*s</b>%7lu /s\n",
+                 (gint)format_app.tooltip.width, label, rate);
+}
+
+/* How fast the memory used is changing and, if it is growing, how long it
+   will be until what is described by end happens */
+static void tooltip_gen_trend(tooltip_t*              tooltip,
+                              const tooltip_source_t* source,
+                              const gchar*            end) {
+  const trend_t* trend = source->trend;
+  gdouble        rate  = trend_get_rate(trend);
+  const gchar*   units = NULL;
+  gdouble        value = get_scaled(fabs(rate), &units);
+
+  tooltip_append_row(tooltip, "Used (avg)", trend->average);
+  tooltip_append(tooltip, "<b>%-*s</b>", (gint)format_app.tooltip.width,
+                 "Trend");
+  if(fabs(rate) < format_app.trend.steady) {
+    tooltip_append(tooltip, "steady\n");
+  } else if(rate < 0) {
+    tooltip_append(tooltip, "draining at %.1f %s/s\n", value, units);
+  } else {
+    tooltip_append(tooltip, "filling at %.1f %s/s, ", value, units);
+    tooltip_append_eta(tooltip,
+                       trend_get_exhaustion(trend, source->stats->total));
+    tooltip_append(tooltip, " to %s\n", end);
+  }
+}
+
+void tooltip_gen_ram(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_t* stats = source->stats;
+
+  tooltip_append_row(tooltip, "Available", stats->available);
+  tooltip_append_row(tooltip, "Free", stats->ram.free);
+  tooltip_append_row(tooltip, "Buffers", stats->ram.buffered);
+  tooltip_append_row(tooltip, "Cached", stats->ram.cached);
+  tooltip_gen_trend(tooltip, source, "OOM");
+  tooltip_append(tooltip, "\n");
+  tooltip_append_row(tooltip, "Total", stats->total);
+}
+
+void tooltip_gen_swap(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_t* stats = source->stats;
+
+  tooltip_append_row(tooltip, "Available", stats->available);
+  tooltip_append_row(tooltip, "Cached", stats->swap.cached);
+  tooltip_gen_trend(tooltip, source, "full");
+  tooltip_append(tooltip, "\n");
+  tooltip_append_row(tooltip, "Total", stats->total);
+}
+
+void tooltip_gen_meminfo(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_meminfo_spec_t* spec  = &stats_spec[source->id].meminfo;
+  const stats_t*              stats = source->stats;
+  guint                       i     = 0;
+
+  /* What is left of the total, not memory that is available for use */
+  tooltip_append_row(tooltip, "Remainder", stats->available);
+  for(i = 0; i < spec->count; i++)
+    tooltip_append_row(tooltip, spec->parts[i].label,
+                       stats->meminfo.parts[i]);
+  tooltip_append(tooltip, "\n");
+  tooltip_append_row(tooltip, spec->total.label, stats->total);
+}
+
+/* The ratio is only shown once something has been compressed */
+void tooltip_gen_zram(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_t*      stats = source->stats;
+  const stats_zram_t* zram  = &stats->zram;
+
+  tooltip_append_row(tooltip, "Resident", zram->resident);
+  tooltip_append_row(tooltip, "Compressed", zram->compressed);
+  tooltip_append_row(tooltip, "Original", zram->original);
+  if(zram->compressed)
+    tooltip_append(tooltip, "<b>%-*s</b>%5.2fx\n",
+                   (gint)format_app.tooltip.width, "Ratio",
+                   (gdouble)zram->original / zram->compressed);
+  tooltip_append(tooltip, "\n");
+  tooltip_append_row(tooltip, "Total", stats->total);
+}
+
+/* The node that is marked is the one shown by a dial that is not split. On a
+   system with more nodes than are read, only the first ones are listed */
+void tooltip_gen_numa(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_numa_t* numa  = &source->stats->numa;
+  const numa_node_t*  node  = NULL;
+  const gchar*        units = NULL;
+  gdouble             value = 0;
+  gchar               label[format_app.tooltip.width + 1];
+  guint               i     = 0;
+
+  for(i = 0; i < numa->count; i++) {
+    node  = &numa->nodes[i];
+    value = get_scaled(node->free, &units);
+    g_snprintf(label, sizeof(label), "Node %u%s", numa->ids[i],
+               i == numa->worst ? " *" : "");
+    tooltip_append(tooltip, "<b>%-*s</b>%3u%% used, %5.1f %s free\n",
+                   (gint)format_app.tooltip.width, label,
+                   get_percent(node->total, node->free), value, units);
+  }
+  /* The nodes that are not read cannot be the one that is marked either */
+  if(numa->found > numa->count)
+    tooltip_append(tooltip, "\n<b>%-*s</b>%u of %u nodes\n",
+                   (gint)format_app.tooltip.width, "Shown", numa->count,
+                   numa->found);
+}
+
+void tooltip_gen_vmstat(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_t*        stats  = source->stats;
+  const stats_vmstat_t* vmstat = &stats->vmstat;
+
+  tooltip_append_rate(tooltip, "Swap in", vmstat->pswpin);
+  tooltip_append_rate(tooltip, "Swap out", vmstat->pswpout);
+  tooltip_append_rate(tooltip, "Major faults", vmstat->pgmajfault);
+  tooltip_append_rate(tooltip, "Alloc stalls", vmstat->allocstall);
+  tooltip_append(tooltip, "\n");
+  tooltip_append_rate(tooltip, "Full at", stats->total);
+}
+
+void tooltip_gen_cgroup(tooltip_t* tooltip, const tooltip_source_t* source) {
+  const stats_t*        stats  = source->stats;
+  const stats_cgroup_t* cgroup = &stats->cgroup;
+
+  if(tooltip_open_tag(tooltip, "<b>", "</b>")) {
+    tooltip_append_escaped(tooltip, source->cgroup,
+                           format_app.tooltip.path, FALSE);
+    tooltip_close_tag(tooltip, "</b>");
+  }
+  tooltip_append(tooltip, "\n\n");
+  tooltip_append_row(tooltip, "Used", cgroup->current);
+  tooltip_append_row(tooltip, "Anon", cgroup->anon);
+  tooltip_append_row(tooltip, "File", cgroup->file);
+  tooltip_append_row(tooltip, "Kernel", cgroup->kernel);
+  tooltip_append_row(tooltip, "Shmem", cgroup->shmem);
+  tooltip_append_row(tooltip, "Swap", cgroup->swap);
+  tooltip_append(tooltip, "\n");
+  tooltip_append_row(tooltip, "Limit", stats->total);
+}
+
+gdouble get_scaled(gulong bytes, const gchar** units) {
+  static const gchar* names[] = {"B", "KB", "MB", "GB", "TB"};
+  gdouble             value   = bytes;
+  guint               i       = 0;
+
+  for(i = 0; value >= 1024 && i + 1 < G_N_ELEMENTS(names); i++)
+    value /= 1024;
+  *units = names[i];
+  return value;
+}
+
+/* The dials go from 0-100 in steps of 5 */
+guint get_pixbuf_index(gulong total, gulong available) {
+  return get_percent(total, available) / 5;
+}
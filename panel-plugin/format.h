@@ -0,0 +1,78 @@
+#ifndef XFCE4_APPLET_MEMORY_FORMAT_H
+#define XFCE4_APPLET_MEMORY_FORMAT_H
+
+/* What the monitors show as text: the markup of the tooltips, and the index
+   of the dial for a sample. This only depends on the stats engine and GLib
+   so that it can be benchmarked without a panel */
+
+#include "stats.h"
+
+/* The constants used by the formatters */
+typedef struct {
+  struct {
+    const gsize size;  /* Size of the markup buffer of each monitor */
+    const guint width; /* Width of the labels */
+    const guint path;  /* Longest cgroup path that is shown */
+  } tooltip;
+  struct {
+    const gdouble steady; /* Slowest rate (bytes/s) that is shown */
+  } trend;
+} format_app_t;
+
+static constexpr format_app_t format_app = {
+    {
+        2048, /* size */
+        12,   /* width */
+        128   /* path */
+    },        /* tooltip */
+    {
+        65536.0 /* steady */
+    }           /* trend */
+};
+
+/* The markup for a tooltip. It is formatted into a fixed buffer when the
+   sample changes and reused for every query until then */
+typedef struct {
+  gchar    buf[format_app.tooltip.size];
+  gsize    len;
+  gsize    reserve; /* Bytes kept free for the tags that are still open */
+  gboolean valid;   /* If not set, the markup is stale */
+  guint    scans;   /* Scans completed when the markup was formatted */
+} tooltip_t;
+
+/* What the tooltip of a monitor is formatted from */
+typedef struct {
+  guint          id; /* In stats_spec[] */
+  const stats_t* stats;
+  const trend_t* trend;
+  const gchar*   cgroup; /* Only used by monitors that read a cgroup */
+} tooltip_source_t;
+
+typedef void (*tooltip_gen_func_t)(tooltip_t*, const tooltip_source_t*);
+
+/* Tooltip functions */
+/* If something does not fit in what is left of the buffer, it is dropped
+   entirely so the markup is never cut in the middle of a tag or entity */
+void     tooltip_clear(tooltip_t*);
+void     tooltip_append(tooltip_t*, const gchar*, ...) G_GNUC_PRINTF(2, 3);
+gboolean tooltip_open_tag(tooltip_t*, const gchar*, const gchar*);
+void     tooltip_close_tag(tooltip_t*, const gchar*);
+void     tooltip_append_escaped(tooltip_t*, const gchar*, guint, gboolean);
+void     tooltip_append_bytes(tooltip_t*, gulong);
+
+/* The rows of the tooltip of each kind of monitor */
+void tooltip_gen_ram(tooltip_t*, const tooltip_source_t*);
+void tooltip_gen_swap(tooltip_t*, const tooltip_source_t*);
+void tooltip_gen_cgroup(tooltip_t*, const tooltip_source_t*);
+void tooltip_gen_meminfo(tooltip_t*, const tooltip_source_t*);
+void tooltip_gen_zram(tooltip_t*, const tooltip_source_t*);
+void tooltip_gen_numa(tooltip_t*, const tooltip_source_t*);
+void tooltip_gen_vmstat(tooltip_t*, const tooltip_source_t*);
+
+/* Scales a number of bytes to the largest unit in which it is at least 1 */
+gdouble get_scaled(gulong, const gchar**);
+
+/* The themed dial that is closest to the percentage used */
+guint get_pixbuf_index(gulong, gulong);
+
+#endif // XFCE4_APPLET_MEMORY_FORMAT_H
@@ -0,0 +1,397 @@
+/* Microbenchmarks for the parts of the plugin that run on every tick or every
+   tooltip query. Every stage is run against each of the meminfo files given
+   on the command line and reports the time, the number of allocations and
+   the number of read/write syscalls per operation. This only links the
+   units that do not need a panel, and the pixbufs come from an icon theme
+   that is not tied to a screen, so it can be run headless with "make bench" */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "format.h"
+#include "pixbufs.h"
+#include "stats.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+  const gchar* io; /* Read and write syscalls made by the process */
+  const gchar* header;
+  const gchar* row;
+  const guint  size;  /* Of the icons and the dials */
+  const gsize  arena; /* Bytes that may be allocated before dlsym() returns */
+  const gchar* summary;
+} bench_app_t;
+
+static constexpr bench_app_t bench = {
+    "/proc/self/io",                      /* io */
+    "%-28s %-16s %12s %12s %12s\n",       /* header */
+    "%-28s %-16s %12.1f %12.3f %12.3f\n", /* row */
+    32,                                   /* size */
+    4096,                                 /* arena */
+    "Time the hot paths of the panel plugin against meminfo files" /* summary */
+};
+
+/* Allocations are counted by wrapping the allocator. The wrappers call the
+   functions that they replace through dlsym(RTLD_NEXT), which is documented
+   for exactly this. Looking them up may itself allocate, so until they have
+   been found, memory is handed out from an arena that is never freed */
+typedef struct {
+  void* (*malloc)(size_t);
+  void* (*calloc)(size_t, size_t);
+  void* (*realloc)(void*, size_t);
+  int (*posix_memalign)(void**, size_t, size_t);
+  void (*free)(void*);
+} allocator_t;
+
+static allocator_t allocator;
+static gboolean    resolving = FALSE;
+static gulong      allocs    = 0;
+static gchar       arena[bench.arena];
+static gsize       arena_used = 0;
+
+static void* arena_alloc(size_t size) {
+  void* ptr = arena + arena_used;
+
+  size = (size + 15) & ~(size_t)15;
+  if(size > sizeof(arena) - arena_used)
+    return NULL;
+  arena_used += size;
+  return ptr;
+}
+
+static gboolean arena_owns(void* ptr) {
+  return (gchar*)ptr >= arena && (gchar*)ptr < arena + sizeof(arena);
+}
+
+/* The functions are only used once all of them have been found */
+static gboolean allocator_resolve() {
+  allocator_t found = {};
+
+  if(allocator.free)
+    return TRUE;
+  if(resolving)
+    return FALSE;
+
+  resolving = TRUE;
+  found.malloc =
+      reinterpret_cast<decltype(found.malloc)>(dlsym(RTLD_NEXT, "malloc"));
+  found.calloc =
+      reinterpret_cast<decltype(found.calloc)>(dlsym(RTLD_NEXT, "calloc"));
+  found.realloc =
+      reinterpret_cast<decltype(found.realloc)>(dlsym(RTLD_NEXT, "realloc"));
+  found.posix_memalign = reinterpret_cast<decltype(found.posix_memalign)>(
+      dlsym(RTLD_NEXT, "posix_memalign"));
+  found.free = reinterpret_cast<decltype(found.free)>(dlsym(RTLD_NEXT, "free"));
+  resolving = FALSE;
+
+  if(!found.malloc || !found.calloc || !found.realloc ||
+     !found.posix_memalign || !found.free)
+    abort();
+  allocator = found;
+  return TRUE;
+}
+
+void* malloc(size_t size) noexcept {
+  if(!allocator_resolve())
+    return arena_alloc(size);
+  allocs++;
+  return allocator.malloc(size);
+}
+
+/* The arena is zeroed since it is never reused */
+void* calloc(size_t n, size_t size) noexcept {
+  if(!allocator_resolve())
+    return size && n > G_MAXSIZE / size ? NULL : arena_alloc(n * size);
+  allocs++;
+  return allocator.calloc(n, size);
+}
+
+/* A block from the arena is moved out of it since the arena never grows */
+void* realloc(void* ptr, size_t size) noexcept {
+  void* moved = NULL;
+
+  if(!allocator_resolve())
+    return NULL;
+  allocs++;
+  if(!arena_owns(ptr))
+    return allocator.realloc(ptr, size);
+  if((moved = allocator.malloc(size)))
+    memcpy(moved, ptr, MIN(size, sizeof(arena) - ((gchar*)ptr - arena)));
+  return moved;
+}
+
+int posix_memalign(void** ptr, size_t align, size_t size) noexcept {
+  if(!allocator_resolve())
+    return ENOMEM;
+  allocs++;
+  return allocator.posix_memalign(ptr, align, size);
+}
+
+void free(void* ptr) noexcept {
+  if(ptr && !arena_owns(ptr) && allocator_resolve())
+    allocator.free(ptr);
+}
+
+/* The state that the stages work on */
+typedef struct {
+  const gchar*     name; /* The file name without the directory */
+  gchar            buf[sizeof(meminfo_reader_t::buf)];
+  gsize            len;
+  meminfo_t        meminfo;
+  meminfo_reader_t reader;
+  meminfo_t        read; /* What the read stage reads into */
+  stats_t          stats[stats_app.monitors];
+  trend_t          trend;
+  tooltip_t        tooltip;
+  pixbufs_t        pixbufs;
+  guint            percent;
+} fixture_t;
+
+typedef struct {
+  const gchar* name;
+  guint        iterations;
+  void (*op)(fixture_t*);
+} stage_t;
+
+static void stage_parse(fixture_t* fixture) {
+  meminfo_parse(fixture->buf, fixture->len, &fixture->meminfo);
+}
+
+static void stage_read(fixture_t* fixture) {
+  meminfo_reader_read(&fixture->reader, &fixture->read);
+}
+
+static void stage_stats_ram(fixture_t* fixture) {
+  stats_read(STATS_RAM, NULL, &fixture->stats[STATS_RAM], &fixture->meminfo);
+}
+
+static void stage_stats_swap(fixture_t* fixture) {
+  stats_read(STATS_SWAP, NULL, &fixture->stats[STATS_SWAP],
+             &fixture->meminfo);
+}
+
+static void stage_index(fixture_t* fixture) {
+  stats_t* stats = &fixture->stats[STATS_RAM];
+
+  fixture->percent += get_pixbuf_index(stats->total, stats->available);
+}
+
+static void stage_dial(fixture_t* fixture) {
+  stats_t* stats = &fixture->stats[STATS_RAM];
+
+  g_object_unref(G_OBJECT(dial_render(
+      bench.size, get_percent(stats->total, stats->available), TRUE, NULL)));
+}
+
+/* The pixbufs are already in the cache, as they are on every tick but the
+   first */
+static void stage_pixbufs(fixture_t* fixture) {
+  pixbufs_update(&fixture->pixbufs, bench.size, TRUE);
+}
+
+static void
+stage_tooltip(fixture_t* fixture, guint id, tooltip_gen_func_t gen) {
+  tooltip_source_t source = {id, &fixture->stats[id], &fixture->trend, NULL};
+
+  tooltip_clear(&fixture->tooltip);
+  gen(&fixture->tooltip, &source);
+}
+
+static void stage_tooltip_ram(fixture_t* fixture) {
+  stage_tooltip(fixture, STATS_RAM, tooltip_gen_ram);
+}
+
+static void stage_tooltip_swap(fixture_t* fixture) {
+  stage_tooltip(fixture, STATS_SWAP, tooltip_gen_swap);
+}
+
+/* In the order in which they run on a tick */
+static const stage_t stages[] = {
+    {"parse", 200000, stage_parse},
+    {"read", 50000, stage_read},
+    {"stats_read_ram", 1000000, stage_stats_ram},
+    {"stats_read_swap", 1000000, stage_stats_swap},
+    {"get_pixbuf_index", 1000000, stage_index},
+    {"dial_render", 2000, stage_dial},
+    {"pixbufs_update", 200000, stage_pixbufs},
+    {"tooltip_ram", 200000, stage_tooltip_ram},
+    {"tooltip_swap", 200000, stage_tooltip_swap},
+};
+
+static gint64 bench_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Returns the number of read and write syscalls made so far. Reading the
+   counters is itself one read, which is subtracted by the caller */
+static gulong bench_syscalls() {
+  gchar  buf[512];
+  gchar* p     = NULL;
+  gulong count = 0;
+  int    fd    = -1;
+  gssize len   = 0;
+
+  if((fd = open(bench.io, O_RDONLY | O_CLOEXEC)) < 0)
+    return 0;
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if(len <= 0)
+    return 0;
+
+  buf[len] = '\0';
+  if((p = strstr(buf, "syscr:")))
+    count += strtoul(p + strlen("syscr:"), NULL, 10);
+  if((p = strstr(buf, "syscw:")))
+    count += strtoul(p + strlen("syscw:"), NULL, 10);
+  return count;
+}
+
+static void bench_run(fixture_t* fixture, const stage_t* stage) {
+  gint64 start    = 0;
+  gint64 end      = 0;
+  gulong a        = 0;
+  gulong syscalls = 0;
+  guint  i        = 0;
+
+  syscalls = bench_syscalls();
+  a        = allocs;
+  start    = bench_now();
+  for(i = 0; i < stage->iterations; i++)
+    stage->op(fixture);
+  end      = bench_now();
+  a        = allocs - a;
+  syscalls = bench_syscalls() - syscalls - 1;
+
+  printf(bench.row, fixture->name, stage->name,
+         (gdouble)(end - start) / stage->iterations,
+         (gdouble)a / stage->iterations,
+         (gdouble)syscalls / stage->iterations);
+}
+
+/* A fixture that does not fit in the buffer that the plugin reads
+   /proc/meminfo into would be cut short, and the stages would then time
+   something other than what the plugin does with it */
+static gboolean bench_load(fixture_t* fixture, const gchar* file) {
+  gchar*  contents = NULL;
+  gsize   len      = 0;
+  GError* error    = NULL;
+
+  if(!g_file_get_contents(file, &contents, &len, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+  if(len >= sizeof(fixture->buf)) {
+    fprintf(stderr, "%s is %" G_GSIZE_FORMAT " bytes but at most %"
+            G_GSIZE_FORMAT " are read\n", file, len, sizeof(fixture->buf) - 1);
+    g_free(contents);
+    return FALSE;
+  }
+
+  fixture->name = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+  fixture->len  = len;
+  memcpy(fixture->buf, contents, len);
+  g_free(contents);
+
+  /* The rest of the stages work on what was parsed even if some of the
+     fields were missing */
+  memset(&fixture->meminfo, 0, sizeof(fixture->meminfo));
+  meminfo_parse(fixture->buf, fixture->len, &fixture->meminfo);
+  stats_read(STATS_RAM, NULL, &fixture->stats[STATS_RAM], &fixture->meminfo);
+  stats_read(STATS_SWAP, NULL, &fixture->stats[STATS_SWAP],
+             &fixture->meminfo);
+  return TRUE;
+}
+
+static void bench_pixbufs_loaded(fixture_t* fixture) {
+  pixbufs_update(&fixture->pixbufs, bench.size, TRUE);
+}
+
+static void cb_bench_pixbufs_loaded(void* data) {
+  bench_pixbufs_loaded((fixture_t*)data);
+}
+
+/* The icons are looked up in the directory as if it were an icon theme, and
+   decoded in the background. This waits until they are in the cache */
+static void bench_load_pixbufs(fixture_t* fixture, const gchar* icons) {
+  GtkIconTheme* theme = gtk_icon_theme_new();
+
+  gtk_icon_theme_set_search_path(theme, &icons, 1);
+  fixture->pixbufs.theme = theme;
+  pixbufs_update(&fixture->pixbufs, bench.size, TRUE);
+  while(fixture->pixbufs.pending)
+    g_main_context_iteration(NULL, TRUE);
+}
+
+static gboolean bench_parse_args(gchar** icons, int* argc, char*** argv) {
+  GOptionContext* context = NULL;
+  GError*         error   = NULL;
+  gboolean        ok      = FALSE;
+
+  const GOptionEntry entries[] = {
+      {"icons", 'i', 0, G_OPTION_ARG_FILENAME, icons,
+       "Directory with the icons and the dials", "DIR"},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  context = g_option_context_new("MEMINFO...");
+  g_option_context_set_summary(context, bench.summary);
+  g_option_context_add_main_entries(context, entries, NULL);
+  if(!(ok = g_option_context_parse(context, argc, argv, &error))) {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  } else if(!*icons) {
+    fprintf(stderr, "The directory with the icons must be given\n");
+    ok = FALSE;
+  } else if(*argc < 2) {
+    fprintf(stderr, "At least one meminfo file must be given\n");
+    ok = FALSE;
+  }
+  g_option_context_free(context);
+
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  static fixture_t fixture;
+  listener_t       listener = {cb_bench_pixbufs_loaded, &fixture};
+  gchar*           icons    = NULL;
+  gboolean         ok       = TRUE;
+  int              i        = 0;
+  guint            j        = 0;
+
+  if(!bench_parse_args(&icons, &argc, &argv))
+    return EXIT_FAILURE;
+
+  pixcache_ref(&listener);
+  bench_load_pixbufs(&fixture, icons);
+
+  printf(bench.header, "fixture", "stage", "ns/op", "allocs/op",
+         "syscalls/op");
+  for(i = 1; ok && i < argc; i++) {
+    if(!(ok = bench_load(&fixture, argv[i])))
+      break;
+    meminfo_reader_init(&fixture.reader, argv[i]);
+    for(j = 0; j < G_N_ELEMENTS(stages); j++)
+      bench_run(&fixture, &stages[j]);
+    meminfo_reader_close(&fixture.reader);
+  }
+
+  pixbufs_delete(&fixture.pixbufs);
+  pixcache_unref(&listener);
+  g_object_unref(G_OBJECT(fixture.pixbufs.theme));
+  g_free(icons);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,126 @@
+#ifndef XFCE4_APPLET_MEMORY_SHM_H
+#define XFCE4_APPLET_MEMORY_SHM_H
+
+/* The snapshot that the plugin publishes on every tick in a POSIX shared
+   memory segment. This header is all that a reader needs. It is plain C and
+   does not depend on GLib.
+
+   Only one process writes the segment, the first panel process of the user
+   to run the plugin. It holds an flock() on the segment for as long as it
+   runs, so readers must not take that lock.
+
+   The segment is written under a seqlock. The sequence number is odd while
+   the plugin is writing, so a reader copies the snapshot out and only keeps
+   the copy if the sequence number was even and did not change. Reading
+   takes no locks and no syscalls once the segment has been mapped:
+
+     memory_shm_t*  shm = memory_shm_open();
+     memory_shm_t   snapshot;
+
+     if(shm && memory_shm_read(shm, &snapshot))
+       ...
+     memory_shm_close(shm);
+
+   The layout only changes when MEMORY_SHM_VERSION does. All sizes are in
+   bytes and all times are real time in microseconds. The one monitor that
+   is not a size is "Swapping", whose values are events per second */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Followed by the uid of the user */
+#define MEMORY_SHM_NAME     "/xfce4-applet-memory."
+#define MEMORY_SHM_MAGIC    0x534d454du /* "MEMS" */
+#define MEMORY_SHM_VERSION  1u
+#define MEMORY_SHM_MONITORS 16u
+#define MEMORY_SHM_FIELDS   8u
+#define MEMORY_SHM_LABEL    16u
+#define MEMORY_SHM_RETRIES  64u /* Before memory_shm_read() gives up */
+
+typedef struct {
+  char     label[MEMORY_SHM_LABEL]; /* Always terminated */
+  uint64_t value;
+} memory_shm_field_t;
+
+typedef struct {
+  char     name[MEMORY_SHM_LABEL]; /* Always terminated */
+  uint32_t enabled;
+  uint32_t value; /* Percentage used in hundredths of a percent */
+  uint64_t total;
+  uint64_t available;
+  uint32_t fields_count;
+  uint32_t reserved;
+  memory_shm_field_t fields[MEMORY_SHM_FIELDS];
+} memory_shm_monitor_t;
+
+typedef struct {
+  uint32_t             magic;
+  uint32_t             version;
+  uint32_t             size; /* Of the whole segment */
+  uint32_t             monitors_count;
+  uint64_t             seq;   /* Odd while the snapshot is being written */
+  int64_t              time;  /* When the stats were read */
+  uint64_t             ticks; /* Number of snapshots published so far */
+  memory_shm_monitor_t monitors[MEMORY_SHM_MONITORS];
+} memory_shm_t;
+
+static inline void memory_shm_get_name(char* buf, size_t size) {
+  snprintf(buf, size, "%s%u", MEMORY_SHM_NAME, (unsigned)getuid());
+}
+
+/* Returns NULL if the plugin is not running or the layout is not one that
+   this header understands */
+static inline memory_shm_t* memory_shm_open(void) {
+  char          name[64];
+  struct stat   st;
+  memory_shm_t* shm = NULL;
+  void*         map = MAP_FAILED;
+  int           fd  = -1;
+
+  memory_shm_get_name(name, sizeof(name));
+  if((fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0)) < 0)
+    return NULL;
+  if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(memory_shm_t))
+    map = mmap(NULL, sizeof(memory_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    return NULL;
+
+  shm = (memory_shm_t*)map;
+  if(shm->magic != MEMORY_SHM_MAGIC || shm->version != MEMORY_SHM_VERSION) {
+    munmap(map, sizeof(memory_shm_t));
+    return NULL;
+  }
+  return shm;
+}
+
+static inline void memory_shm_close(memory_shm_t* shm) {
+  if(shm)
+    munmap(shm, sizeof(memory_shm_t));
+}
+
+/* Copies a consistent snapshot into out. Returns 0 if the plugin kept
+   writing for MEMORY_SHM_RETRIES attempts, which only happens if it died
+   halfway through a write */
+static inline int memory_shm_read(const memory_shm_t* shm, memory_shm_t* out) {
+  uint64_t seq = 0;
+  unsigned i   = 0;
+
+  for(i = 0; i < MEMORY_SHM_RETRIES; i++) {
+    seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+    if(seq & 1)
+      continue;
+    memcpy(out, shm, sizeof(memory_shm_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+      return 1;
+  }
+  return 0;
+}
+
+#endif // XFCE4_APPLET_MEMORY_SHM_H
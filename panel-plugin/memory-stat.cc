@@ -0,0 +1,188 @@
+/* Streams the samples of the stats engine to stdout without a panel. By
+   default every sample is a line containing the time (ms since the epoch)
+   followed by name:used:total for each monitor, in bytes. With --binary,
+   every monitor in a sample is written as a stat_record_t instead */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "stats.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+typedef struct {
+  const gint   interval; /* Default interval (ms) between samples */
+  const gint   minimum;  /* Shortest interval (ms) that is accepted */
+  const gchar* summary;
+} stat_app_t;
+
+static constexpr stat_app_t stat_app = {
+    1000, /* interval */
+    10,   /* minimum */
+    "Stream the memory usage as seen by the panel plugin" /* summary */
+};
+
+/* A binary record. These are written in host byte order with no padding */
+typedef struct {
+  guint64 time;      /* ms since the epoch */
+  guint32 monitor;   /* Index into stats_spec[] */
+  guint32 value;     /* Percentage used in hundredths of a percent */
+  guint64 total;     /* in bytes */
+  guint64 available; /* in bytes */
+} stat_record_t;
+
+static_assert(sizeof(stat_record_t) == 32, "Padding in stat_record_t");
+
+typedef struct {
+  gint     interval; /* in ms */
+  gint     count;    /* Number of samples, or 0 to run until killed */
+  gboolean binary;
+  gchar*   cgroup; /* The cgroup monitor is only sampled if this is set */
+} stat_opts_t;
+
+typedef struct {
+  stat_opts_t      opts;
+  meminfo_reader_t reader;
+  meminfo_t        meminfo;
+  gboolean         enabled[stats_app.monitors];
+  stats_files_t    files[stats_app.monitors];
+  stats_t          stats[stats_app.monitors];
+} stat_t;
+
+static void stat_write_text(stat_t* stat, gint64 time) {
+  stats_t* stats = NULL;
+  guint    i     = 0;
+
+  printf("%" G_GINT64_FORMAT, time);
+  for(i = 0; i < stats_app.monitors; i++) {
+    stats = &stat->stats[i];
+    if(stat->enabled[i])
+      printf(" %s:%lu:%lu", stats_spec[i].name,
+             stats->total - stats->available, stats->total);
+  }
+  putchar('\n');
+}
+
+static void stat_write_binary(stat_t* stat, gint64 time) {
+  stat_record_t record = {};
+  stats_t*      stats  = NULL;
+  guint         i      = 0;
+
+  for(i = 0; i < stats_app.monitors; i++) {
+    stats = &stat->stats[i];
+    if(!stat->enabled[i])
+      continue;
+    record.time      = time;
+    record.monitor   = i;
+    record.value     = get_value(stats->total, stats->available);
+    record.total     = stats->total;
+    record.available = stats->available;
+    fwrite(&record, sizeof(record), 1, stdout);
+  }
+}
+
+/* The monitors that do not depend on /proc/meminfo are still sampled if it
+   could not be read */
+static gboolean stat_sample(stat_t* stat) {
+  gint64           time    = g_get_real_time() / 1000;
+  const meminfo_t* meminfo = &stat->meminfo;
+  guint            i       = 0;
+
+  if(!meminfo_reader_read(&stat->reader, &stat->meminfo)) {
+    fprintf(stderr, "Could not read %s\n", stats_app.meminfo);
+    meminfo = NULL;
+  }
+  for(i = 0; i < stats_app.monitors; i++)
+    if(stat->enabled[i] &&
+       !stats_read(i, &stat->files[i], &stat->stats[i], meminfo))
+      stat->stats[i].total = stat->stats[i].available = 0;
+
+  if(stat->opts.binary)
+    stat_write_binary(stat, time);
+  else
+    stat_write_text(stat, time);
+  return fflush(stdout) == 0;
+}
+
+/* Sleeps until the next multiple of the interval after start so that the
+   samples do not drift by the time it takes to take each one */
+static void stat_wait(stat_t* stat, gint64 start, gint n) {
+  gint64 deadline = start + (gint64)n * stat->opts.interval * 1000;
+  gint64 now      = g_get_monotonic_time();
+
+  if(deadline > now)
+    g_usleep(deadline - now);
+}
+
+static gboolean stat_parse_args(stat_t* stat, int* argc, char*** argv) {
+  stat_opts_t*    opts    = &stat->opts;
+  GOptionContext* context = NULL;
+  GError*         error   = NULL;
+  gboolean        ok      = FALSE;
+
+  const GOptionEntry entries[] = {
+      {"interval", 'i', 0, G_OPTION_ARG_INT, &opts->interval,
+       "Interval between samples", "MS"},
+      {"count", 'n', 0, G_OPTION_ARG_INT, &opts->count,
+       "Stop after this many samples", "N"},
+      {"binary", 'b', 0, G_OPTION_ARG_NONE, &opts->binary,
+       "Write binary records instead of lines", NULL},
+      {"cgroup", 'c', 0, G_OPTION_ARG_STRING, &opts->cgroup,
+       "Also sample this cgroup, relative to /sys/fs/cgroup", "PATH"},
+      {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+  context = g_option_context_new(NULL);
+  g_option_context_set_summary(context, stat_app.summary);
+  g_option_context_add_main_entries(context, entries, NULL);
+  if(!(ok = g_option_context_parse(context, argc, argv, &error))) {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  } else if(opts->interval < stat_app.minimum) {
+    fprintf(stderr, "The interval must be at least %d ms\n", stat_app.minimum);
+    ok = FALSE;
+  } else if(opts->count < 0) {
+    fprintf(stderr, "The count must not be negative\n");
+    ok = FALSE;
+  }
+  g_option_context_free(context);
+
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  static stat_t stat;
+  gboolean      ok    = FALSE;
+  gint64        start = 0;
+  gint          n     = 0;
+  guint         i     = 0;
+
+  stat.opts.interval = stat_app.interval;
+  if(!stat_parse_args(&stat, &argc, &argv))
+    return EXIT_FAILURE;
+
+  meminfo_reader_init(&stat.reader, NULL);
+  for(i = 0; i < stats_app.monitors; i++) {
+    stat.enabled[i] = !stats_spec[i].path || stat.opts.cgroup;
+    if(stat.enabled[i] && stats_spec[i].open)
+      stats_spec[i].open(&stat.files[i], stat.opts.cgroup);
+    if(stat.enabled[i] && stats_spec[i].ceiling)
+      stats_spec[i].ceiling(&stat.stats[i], stats_app.vmstat.ceiling);
+  }
+
+  start = g_get_monotonic_time();
+  for(n = 1; (ok = stat_sample(&stat)); n++) {
+    if(stat.opts.count && n >= stat.opts.count)
+      break;
+    stat_wait(&stat, start, n);
+  }
+
+  for(i = 0; i < stats_app.monitors; i++)
+    if(stat.enabled[i] && stats_spec[i].close)
+      stats_spec[i].close(&stat.files[i]);
+  meminfo_reader_close(&stat.reader);
+  g_free(stat.opts.cgroup);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,11 +7,29 @@
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxfce4util/libxfce4util.h>
 
+#include "format.h"
+#include "memory-shm.h"
+#include "pixbufs.h"
+#include "stats.h"
+
+#include <glib-unix.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 typedef struct {
   gdouble min;
@@ -19,21 +37,101 @@ typedef struct {
   gdouble step;
 } range_t;
 
+/* What each monitor shows next to its icon */
+static const guint DISPLAY_DIAL  = 0;
+static const guint DISPLAY_GRAPH = 1;
+static const guint DISPLAY_BOTH  = 2;
+
+/* The stages of the hot path that are timed */
+static const guint PROBE_MEMINFO = 0;
+static const guint PROBE_STATS   = 1;
+static const guint PROBE_GUI     = 2;
+static const guint PROBE_PIXBUFS = 3;
+static const guint PROBE_TOOLTIP = 4;
+static const guint PROBE_STAGES  = 5;
+
+/* How close a monitor is to running out */
+static const guint LEVEL_NORMAL   = 0;
+static const guint LEVEL_WARNING  = 1;
+static const guint LEVEL_CRITICAL = 2;
+static const guint LEVELS         = 3;
+
 /* This is effectively a resource file for all the constants in the plugin */
 /* Yes, this is C++, but I don't want to bring in STL */
 typedef struct {
-  const guint  monitors;
-  const gchar* meminfo;
+  const guint monitors;
+  struct {
+    const gchar* proc;
+    const guint  count;  /* Number of processes shown in the tooltip */
+    const guint  period;  /* Period (ms) of the background scans */
+    const guint  fresh;   /* Age (ms) after which a tooltip triggers a scan */
+    const guint  idle;    /* Time (ms) after the last tooltip to stop scans */
+    const guint  slice;   /* Most entries of /proc looked at in one go */
+    const guint  pause;   /* Time (ms) between the slices of a scan */
+    const guint  refresh; /* Scans between reads of a process not at the top */
+  } scanner;
+  struct {
+    const guint32 magic;
+    const guint32 version;
+    const guint   capacity; /* Number of samples kept for each monitor */
+    const gchar*  suffix;
+  } history;
+  struct {
+    const gchar* file;
+    const gchar* trigger;
+    const guint  period; /* Slowest period (ms) to poll at when triggered */
+  } pressure;
+  struct {
+    const gchar* statm;
+    const guint  buckets; /* The last one also counts anything slower */
+    const guint  period;  /* Period (ms) with which the tab is refreshed */
+    const gchar* stages[PROBE_STAGES];
+  } probe;
+  struct {
+    const gchar* name;
+    const gchar* path; /* Each instance appends its unique id */
+    const gchar* interface;
+    const gchar* xml;
+  } bus;
   struct {
-    const gchar* base;
-    const guint  count;
-  } dials;
+    const guint period;   /* Period (ms) with which a burst is sampled */
+    const guint duration; /* Longest burst (ms) that may be asked for */
+  } burst;
+  struct {
+    const guint slots; /* Ticks that may be in flight at once */
+    const guint batch; /* Most subscribers that are read in a tick */
+  } sampler;
+  struct {
+    const guint   hysteresis; /* Points below a threshold before it clears */
+    const guint   burst;      /* Duration (ms) of the burst on a crossing */
+    const gdouble colours[LEVELS][3]; /* Of the dial. Unused when normal */
+    const gchar*  summaries[LEVELS];  /* Of the notification */
+    const gchar*  rates[LEVELS];      /* Summaries for monitors of a rate */
+    const gchar*  name;               /* Of the notification service */
+    const gchar*  path;
+    const gchar*  interface;
+  } alert;
+  struct {
+    const gdouble horizon; /* Colour the dial if it runs out sooner (s) */
+    const gdouble colour[3];
+  } trend;
   struct {
     const gchar* period;
     const gchar* enable;
     const gchar* icon;
     const gchar* border;
     const gchar* padding;
+    const gchar* themed;
+    const gchar* ramp;
+    const gchar* pressure;
+    const gchar* adaptive;
+    const gchar* ceiling;
+    const gchar* display;
+    const gchar* cgroup;
+    const gchar* warning;
+    const gchar* critical;
+    const gchar* notify;
+    const gchar* rate;
   } rc;
   struct {
     const gulong   period;
@@ -41,6 +139,17 @@ typedef struct {
     const gboolean icon;
     const guint    border;
     const guint    padding;
+    const gboolean themed;
+    const gboolean ramp;
+    const gboolean pressure;
+    const gboolean adaptive;
+    const gulong   ceiling;
+    const guint    display;
+    const gchar*   cgroup; /* Relative to stats_app.cgroup.root */
+    const guint    warning;
+    const guint    critical;
+    const gboolean notify;
+    const gulong   rate; /* Events per second at which the dial is full */
   } defaults;
   struct {
     struct {
@@ -51,44 +160,317 @@ typedef struct {
     const range_t border;
     const range_t padding;
     const range_t period;
+    const range_t ceiling;
+    const range_t threshold;
+    const range_t rate;
   } config; /* Parameters for the config dialog */
 } app_t;
 
 static constexpr app_t app = {
-    2,               /* 2 monitors, RAM and Swap */
-    "/proc/meminfo", /* file */
+    stats_app.monitors, /* monitors */
+    {
+        "/proc", /* proc */
+        5,       /* count */
+        60000,   /* period */
+        2000,    /* fresh */
+        600000,  /* idle */
+        256,     /* slice */
+        10,      /* pause */
+        4        /* refresh */
+    },           /* scanner */
+    {
+        0x484d454d, /* magic ("MEMH") */
+        1,          /* version */
+        3600,       /* capacity */
+        ".history"  /* suffix */
+    },              /* history */
+    {
+        "/proc/pressure/memory", /* file */
+        /* Stalled for 150ms in a 2s window. Unprivileged users may only use
+           windows that are a multiple of 2s */
+        "some 150000 2000000", /* trigger */
+        60000                  /* period */
+    },                         /* pressure */
     {
-        "xfce-applet-memory-dial-%03d", /* base */
-        21 /* The dial moves from 0-100 in steps of 5 (inclusive) */
-    },     /* dials */
-    {"period", "enable", "icon", "border", "padding"}, /* rc */
-    {10000 /* 10 seconds */, TRUE, TRUE, 1, 1},        /* defaults */
+        "/proc/self/statm", /* statm */
+        16,                 /* buckets */
+        1000,               /* period */
+        {"meminfo", "stats_read", "update_gui", "pixbufs_update",
+         "gen_tooltip"} /* stages */
+    },                  /* probe */
     {
-        {8, 4, 12}, /* config.display */
-        {0, 16, 1}, /* config.border */
-        {0, 16, 1}, /* config.padding */
-        {1, 60, 1}  /* config.period */
-    }               /* config */
+        "org.xfce.AppletMemory",  /* name */
+        "/org/xfce/AppletMemory", /* path */
+        "org.xfce.AppletMemory",  /* interface */
+        /* The value of a monitor is the percentage used in hundredths of a
+           percent. The times are the real time (us) of the sample */
+        "<node>"
+        "  <interface name='org.xfce.AppletMemory'>"
+        "    <method name='GetSnapshot'>"
+        "      <arg name='time' type='x' direction='out'/>"
+        "      <arg name='monitors' type='a(sbttua{st})' direction='out'/>"
+        "    </method>"
+        "    <method name='SetPeriod'>"
+        "      <arg name='monitor' type='s' direction='in'/>"
+        "      <arg name='period' type='u' direction='in'/>"
+        "    </method>"
+        "    <method name='Burst'>"
+        "      <arg name='duration' type='u' direction='in'/>"
+        "    </method>"
+        "    <signal name='SamplesChanged'>"
+        "      <arg name='time' type='x'/>"
+        "    </signal>"
+        "  </interface>"
+        "</node>" /* xml */
+    },            /* bus */
+    {
+        250,  /* period */
+        60000 /* duration */
+    },        /* burst */
+    {
+        8, /* slots */
+        32 /* batch */
+    },     /* sampler */
+    {
+        5,     /* hysteresis */
+        10000, /* burst */
+        {{0, 0, 0}, {0.96, 0.62, 0.04}, {0.80, 0.00, 0.00}}, /* colours */
+        {NULL, "Memory is running low",
+         "Memory is almost exhausted"},   /* summaries */
+        {NULL, "The system is swapping",
+         "The system is thrashing"},      /* rates */
+        "org.freedesktop.Notifications",  /* name */
+        "/org/freedesktop/Notifications", /* path */
+        "org.freedesktop.Notifications"   /* interface */
+    },                                    /* alert */
+    {
+        600.0,             /* horizon */
+        {0.55, 0.25, 0.75} /* colour */
+    },                     /* trend */
+    {"period", "enable", "icon", "border", "padding", "themed", "ramp",
+     "pressure", "adaptive", "ceiling", "display", "cgroup", "warning",
+     "critical", "notify", "rate"}, /* rc */
+    {10000 /* 10 seconds */, TRUE, TRUE, 1, 1, FALSE, TRUE, FALSE, FALSE,
+     60000 /* 1 minute */, DISPLAY_DIAL, "user.slice", 80, 95, FALSE,
+     stats_app.vmstat.ceiling}, /* defaults */
+    {
+        {8, 4, 12},      /* config.display */
+        {0, 16, 1},      /* config.border */
+        {0, 16, 1},      /* config.padding */
+        {1, 60, 1},      /* config.period */
+        {1, 600, 1},     /* config.ceiling */
+        {1, 100, 1},     /* config.threshold */
+        {10, 100000, 10} /* config.rate */
+    }                    /* config */
 };
 
+/* Called on the sampler thread with NULL if /proc/meminfo could not be
+   read. Returns whether the read succeeded */
+typedef gboolean (*sampler_read_t)(const meminfo_t*, void*);
+/* Called on the main thread once the read has come back, with the
+   monotonic time (us) at which it was made */
+typedef void (*sampler_notify_t)(gboolean, gint64, void*);
+/* Frees what is read once it is no longer wanted. This may be called on the
+   sampler thread */
+typedef void (*sampler_release_t)(void*);
+
+/* What is read for a subscriber. It is only touched by the sampler thread
+   while a read of it is in flight. A subscriber that goes away hands it
+   over to the sampler, which releases it once the read has come back, so
+   that a read that is stuck never holds up the main thread */
+typedef struct {
+  sampler_read_t    read;
+  sampler_release_t release;
+  void*             data;
+  gboolean          dropped; /* Whether it now belongs to the sampler */
+} job_t;
+
+/* A subscriber to the sampler. These are embedded in the objects that
+   subscribe so the sampler never needs to allocate anything */
 typedef struct {
-  gulong free;
-  gulong buffered;
-  gulong cached;
-} stats_dram_t;
+  job_t*           job;
+  sampler_notify_t notify;
+  void*            data;
+  guint            period;   /* in ms */
+  gboolean         pressure; /* Also notify on memory pressure */
+  gint64           due;      /* Monotonic time (us) of the next notification */
+  gboolean         pending;  /* Whether a read of it is in flight */
+} subscriber_t;
+
+/* A read of /proc/meminfo and of every subscriber that was due with it. It
+   is queued to the sampler thread, which fills in the results and queues it
+   back */
+typedef struct {
+  subscriber_t* subs[app.sampler.batch]; /* Only valid unless dropped */
+  job_t*        jobs[app.sampler.batch];
+  gboolean      ok[app.sampler.batch];    /* Whether each of them was read */
+  gint64        ns[app.sampler.batch];    /* Time taken to read each of them */
+  gint64        times[app.sampler.batch]; /* Monotonic time (us) of each */
+  guint         count;
+  gint64        due;        /* Monotonic time (us) at which it was queued */
+  gboolean      valid;      /* Whether /proc/meminfo could be read */
+  gint64        ns_meminfo; /* Time taken to read /proc/meminfo */
+  gint64        time;       /* Real time (us) of the read */
+  meminfo_t     meminfo;
+} tick_t;
+
+/* A lock-free queue of ticks between the main thread and the sampler
+   thread. There is a single producer and a single consumer so each index is
+   only ever written by one side. The consumer waits on the eventfd, which
+   the producer signals after every push */
+typedef struct {
+  tick_t slots[app.sampler.slots];
+  guint  head; /* Written by the producer */
+  guint  tail; /* Written by the consumer */
+  int    fd;
+} ring_t;
+
+/* What is shared with the sampler thread. It is on the heap so that when
+   the sampler goes away, it can be handed to the thread to free once any
+   read that is stuck has returned, instead of waiting for it */
+typedef struct {
+  ring_t           todo; /* Ticks to be read */
+  ring_t           done; /* Ticks that have been read */
+  meminfo_reader_t reader;
+  gboolean         quit; /* Set once the main thread has let go of it */
+  gint             refs; /* One for each of the threads */
+} worker_t;
+
+/* There is only one sampler in the process. It is shared by every monitor in
+   every instance of the plugin so /proc/meminfo is read once per tick. The
+   timers run on the main thread but the files are read on a thread of the
+   sampler's own, since a read of /proc can stall for a long time when
+   memory is short, which is exactly when the panel should not freeze */
+typedef struct {
+  guint            refs;
+  guint            timer;
+  guint            period; /* Period (ms) with which the timer is armed */
+  guint            idle;
+  int              psi; /* PSI trigger on /proc/pressure/memory if any */
+  guint            psi_watch;
+  meminfo_reader_t reader; /* Only used if there is no sampler thread */
+  GSList*          subscribers;
+  gint64           time;    /* Real time (us) of the last read */
+  worker_t*        worker;  /* NULL if the reads are done on the main thread */
+  guint            watch;   /* Of worker->done.fd */
+  guint            pending; /* Ticks in todo, being read or in done */
+} sampler_t;
+
+/* There is only one connection in the process. Every instance of the plugin
+   owns a bus name of its own, app.bus.name followed by ".i" and the unique
+   id of the instance, since the panel may run each instance in a separate
+   process. It exports an object on the connection once it is made */
+typedef struct {
+  guint            refs;
+  GDBusConnection* connection;
+  GDBusNodeInfo*   info;
+  GSList*          plugins;
+} bus_t;
 
+/* The object exported by an instance of the plugin */
+typedef struct {
+  gchar* name;
+  gchar* path;
+  guint  owner;
+  guint  id; /* 0 until the object has been registered */
+} bus_object_t;
+
+/* There is only one snapshot in the process. It is published in a shared
+   memory segment on every tick so that other programs can read the stats
+   without reading /proc themselves. The segment has a single writer, the
+   process that holds an exclusive lock on it. Any other process that runs
+   the plugin does not publish at all. If there is more than one instance of
+   the plugin in the process, only the monitors of the first one are
+   published */
 typedef struct {
-  gulong cached;
-} stats_swap_t;
+  guint         refs;
+  memory_shm_t* shm; /* NULL if this process does not publish */
+  int           fd;  /* Holds the lock. Only valid if shm is set */
+  GSList*       plugins;
+} snapshot_t;
 
+static_assert(stats_app.monitors <= MEMORY_SHM_MONITORS,
+              "Too many monitors for the snapshot");
+
+/* A process using a lot of memory */
+typedef struct {
+  gint   pid;
+  gulong rss;      /* in bytes */
+  gchar  name[16]; /* From /proc/[pid]/comm */
+} process_t;
+
+/* The result of a scan of /proc. It is filled in on a worker thread */
+typedef struct {
+  process_t top[app.scanner.count]; /* Most memory first */
+  guint     count;
+} scan_t;
+
+/* A process that the scanner has seen. These are kept from one scan to the
+   next so that the statm of a process is only opened and read when it is
+   new. The others are read again every app.scanner.refresh scans, except
+   the ones at the top whose statm is kept open and read on every scan */
+typedef struct {
+  gint   pid;
+  gint64 start;    /* Change time (us) of /proc/[pid], to tell reused pids */
+  gulong rss;      /* in bytes, as of the last read */
+  guint  scan;     /* Number of the last scan that saw it */
+  int    fd;       /* Of statm while it is at the top, -1 otherwise */
+  gchar  name[16]; /* Only read once it has made it to the top */
+} tracked_t;
+
+/* A scan of /proc that is done a slice at a time. It belongs to the worker
+   thread while a slice is running and to the main thread in between */
+typedef struct {
+  GHashTable* tracked; /* Of tracked_t by pid */
+  DIR*        dir;     /* NULL between scans */
+  guint       scan;    /* Number of the scan in progress or last done */
+  gboolean    done;    /* Whether the last slice completed the scan */
+  scan_t      top;     /* Built up over the slices of the scan */
+} walk_t;
+
+/* There is only one scanner in the process. It finds the processes using the
+   most memory on a worker thread so walking /proc never blocks the panel.
+   Nothing is scanned until a tooltip that shows the result is requested.
+   After that, it rescans slowly in the background until no such tooltip has
+   been requested for a while, and more often while one is open. Until a scan
+   completes, the previous result is used */
 typedef struct {
-  gulong total;
-  gulong available;
-  union {
-    stats_dram_t ram;
-    stats_swap_t swap;
-  };
-} stats_t;
+  guint    refs;
+  guint    timer;     /* Only runs while tooltips are being requested */
+  guint    pause;     /* Before the next slice of the scan in progress */
+  GTask*   task;      /* The slice in progress, if any */
+  walk_t*  walk;      /* Created with the first scan */
+  gboolean tooltip;   /* Refresh the tooltip when the scan completes */
+  gint64   time;      /* Monotonic time (us) when the last scan completed */
+  gint64   requested; /* Monotonic time (us) of the last tooltip request */
+  guint    scans;     /* Number of scans completed */
+  scan_t   scan;
+} scanner_t;
+
+/* The timings of a stage of the hot path. The histogram has a bucket for
+   each power of 2 us, the first one being anything under 1 us */
+typedef struct {
+  guint64 count;
+  gint64  total; /* in ns */
+  gint64  min;
+  gint64  max;
+  guint64 buckets[app.probe.buckets];
+} timing_t;
+
+/* There is only one probe in the process. It measures what the plugin
+   itself costs. Taking a timing is a clock_gettime() from the vDSO and a
+   few additions, so it is always on */
+typedef struct {
+  timing_t timings[PROBE_STAGES];
+  guint64  wakeups; /* Times the main loop was woken up for the plugin */
+} probe_t;
+
+/* The hidden diagnostics tab of the config dialog */
+typedef struct {
+  gboolean   shown; /* Set once it has been asked for by a remote event */
+  guint      timer;
+  GtkWidget* label;
+} diagnostics_t;
 
 typedef struct {
   guint    border;
@@ -96,52 +478,154 @@ typedef struct {
   guint    period;
   gboolean enable;
   gboolean icon;
+  gboolean themed;   /* Use the themed dial icons instead of drawing it */
+  gboolean ramp;     /* Colour the drawn dial by the percentage used */
+  gboolean pressure; /* Sample when the kernel reports memory pressure */
+  gboolean adaptive; /* Back off from period to ceiling while stable */
+  guint    ceiling;  /* in ms */
+  guint    display;  /* One of the DISPLAY_* constants */
+  gchar*   cgroup;   /* Only used by monitors that read a cgroup */
+  guint    warning;  /* Percentage used */
+  guint    critical; /* Percentage used */
+  gboolean notify;   /* Send a notification when a threshold is crossed */
+  guint    rate;     /* Only used by monitors that measure a rate */
 } opts_t;
 
 typedef struct {
   GtkWidget* grid;
   GtkWidget* img_icon;
   GtkWidget* img_dial;
+  GtkWidget* graph;
 } gui_t;
 
+/* A sample in the history is packed into a single word. The high half is the
+   number of seconds since the previous sample and the low half is the
+   percentage used in hundredths of a percent */
+typedef guint32 sample_t;
+
+/* The start of the history file. The samples follow immediately after */
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint32 capacity;
+  guint32 reserved;
+  /* The time (s) of the newest sample in the high half and the number of
+     samples written in the low half. These are kept in one word so that
+     a sample is published with a single store */
+  guint64 cursor;
+} history_header_t;
+
+/* A ring buffer of samples. It is mapped from a file next to the rc file so
+   that it survives restarts. If that cannot be done, it is kept in memory.
+   Either way, it is allocated once and nothing is allocated when samples are
+   added */
 typedef struct {
-  GdkPixbuf* icons[app.monitors];
-  GdkPixbuf* tooltips[app.monitors];
-  GdkPixbuf* dials[app.dials.count];
-} pixbufs_t;
+  history_header_t* header;
+  sample_t*         samples;
+  gsize             size;
+  gchar*            file; /* NULL if the history is only kept in memory */
+} history_t;
+
+/* The graph is drawn into an image surface one column per sample. When a
+   sample is added, the surface is shifted by a column and only the new column
+   is drawn. The widget just paints the surface */
+typedef struct {
+  cairo_surface_t* surface;
+  guint            width;
+  guint            height;
+  gboolean         ramp;
+} graph_t;
+
+/* What was last rendered so the widgets are only touched when something has
+   actually changed */
+typedef struct {
+  gboolean       valid; /* If not set, the fields below are stale */
+  gboolean       shown; /* Whether the grid is visible */
+  gboolean       icon;
+  guint64        index;  /* See monitor_get_index() */
+  const gdouble* colour; /* See monitor_get_colour() */
+  guint          border;
+  guint          padding;
+  guint          display;
+} render_t;
 
 typedef struct {
   GtkWidget* grid;
   GtkWidget* chk_show;
   GtkWidget* chk_icon;
   GtkWidget* spin_period;
+  GtkWidget* spin_ceiling;
+  GtkWidget* spin_warning;
+  GtkWidget* spin_critical;
+  GtkWidget* txt_cgroup; /* NULL unless the monitor reads a cgroup */
 } config_t;
 
+/* What a monitor is read into on the sampler thread. It is the data of the
+   job of the monitor, so it is on the heap and outlives the monitor if the
+   monitor is deleted while it is being read. Only the stats are copied to
+   the monitor when the read comes back */
+typedef struct {
+  job_t         job;
+  guint         id;
+  gboolean      open; /* Whether the files are open */
+  stats_files_t files;
+  stats_t       stats;
+} reading_t;
+
 typedef struct {
-  guint      id;
-  int        timer;
-  gui_t      gui;
-  config_t   config;
-  opts_t     opts;
-  stats_t    stats;
-  pixbufs_t* pixbufs;
+  guint        id;
+  subscriber_t sub;
+  gui_t        gui;
+  render_t     render;
+  config_t     config;
+  opts_t       opts;
+  stats_t      stats;   /* The last sample that came back */
+  reading_t*   reading; /* Read into on the sampler thread */
+  gboolean     reopen;  /* Held back until the pending read has come back */
+  pixbufs_t*   pixbufs;
+  gchar*       file;    /* Of the history. NULL to keep it in memory */
+  history_t    history; /* Only open while the monitor is enabled */
+  graph_t      graph;
+  tooltip_t    tooltip;
+  guint64      index;  /* Dial index of the last sample */
+  gint64       burst;  /* Monotonic time (us) at which a burst ends */
+  guint        period; /* Set over the bus (ms). 0 to use opts.period */
+  guint        level;  /* One of the LEVEL_* constants */
+  trend_t      trend;
 } monitor_t;
 
 typedef struct {
   XfcePanelPlugin* xfce;
   GtkWidget*       evt;
   GtkWidget*       box;
+  listener_t       listener; /* Notified when pixbufs have been loaded */
   pixbufs_t        pixbufs;
+  diagnostics_t    diagnostics;
+  bus_object_t     bus;
   monitor_t        monitors[app.monitors];
 } plugin_t;
 
 /* Config dialog callbacks */
 static void cb_config_period_changed(GtkWidget*, void*);
+static void cb_config_adaptive_toggled(GtkWidget*, void*);
+static void cb_config_ceiling_changed(GtkWidget*, void*);
 static void cb_config_enable_toggled(GtkWidget*, void*);
 static void cb_config_icon_toggled(GtkWidget*, void*);
 static void cb_config_border_changed(GtkWidget*, void*);
 static void cb_config_padding_changed(GtkWidget*, void*);
+static void cb_config_themed_toggled(GtkWidget*, void*);
+static void cb_config_ramp_toggled(GtkWidget*, void*);
+static void cb_config_pressure_toggled(GtkWidget*, void*);
+static void cb_config_display_changed(GtkWidget*, void*);
+static void     cb_config_cgroup_changed(GtkWidget*, void*);
+static gboolean cb_config_cgroup_focus_out(GtkWidget*, GdkEventFocus*, void*);
+static void cb_config_warning_changed(GtkWidget*, void*);
+static void cb_config_critical_changed(GtkWidget*, void*);
+static void cb_config_rate_changed(GtkWidget*, void*);
+static void cb_config_notify_toggled(GtkWidget*, void*);
 static void cb_config_response(GtkWidget*, int, plugin_t*);
+static gboolean cb_config_diagnostics_tick(void*);
+static void     cb_config_diagnostics_destroyed(GtkWidget*, plugin_t*);
 
 /* Plugin callbacks */
 static void cb_plugin_about(XfcePanelPlugin*);
@@ -155,15 +639,91 @@ static gboolean cb_plugin_remote_event(XfcePanelPlugin*,
                                        plugin_t*);
 static void     cb_plugin_save(XfcePanelPlugin*, plugin_t*);
 static void     cb_plugin_size_changed(XfcePanelPlugin*, int, plugin_t*);
+static void     cb_plugin_theme_changed(GtkIconTheme*, plugin_t*);
+static void     cb_plugin_pixbufs_loaded(void*);
+static void     cb_plugin_remove(XfcePanelPlugin*, plugin_t*);
 
 /* Monitor callbacks */
-static int cb_monitor_timer_tick(void*);
+static gboolean cb_reading_read(const meminfo_t*, void*);
+static void     cb_reading_release(void*);
+static void     cb_monitor_sample(gboolean, gint64, void*);
 static gboolean cb_monitor_gen_tooltip(
     GtkWidget*, gint, gint, gboolean, GtkTooltip*, monitor_t*);
-
-/* Pixbufs functions */
-static void pixbufs_update(pixbufs_t*, plugin_t*);
-static void pixbufs_delete(pixbufs_t*);
+static gboolean cb_monitor_draw_graph(GtkWidget*, cairo_t*, monitor_t*);
+
+/* Sampler callbacks */
+static gboolean cb_sampler_timer_tick(void*);
+static gboolean cb_sampler_idle(void*);
+static gboolean cb_sampler_pressure(gint, GIOCondition, void*);
+static gboolean cb_sampler_done(gint, GIOCondition, void*);
+static gpointer cb_sampler_thread(gpointer);
+
+/* Ring functions */
+static gboolean ring_open(ring_t*, int);
+static void     ring_close(ring_t*);
+static gboolean ring_push(ring_t*, const tick_t*);
+static gboolean ring_pop(ring_t*, tick_t*);
+static gboolean ring_signal(ring_t*);
+static gboolean ring_wait(ring_t*);
+
+/* Worker functions */
+static worker_t* worker_new();
+static void      worker_delete(worker_t*);
+static void      worker_unref(worker_t*);
+
+/* Sampler functions */
+static guint sampler_get_period(subscriber_t*);
+static void  sampler_update_timer();
+static void  sampler_ref();
+static void  sampler_unref();
+static void  sampler_subscribe(subscriber_t*);
+static void  sampler_unsubscribe(subscriber_t*);
+static void  sampler_drop(subscriber_t*);
+static void  sampler_run(worker_t*);
+
+/* Bus callbacks */
+static void cb_bus_acquired(GDBusConnection*, const gchar*, void*);
+static void cb_bus_name_lost(GDBusConnection*, const gchar*, void*);
+static void cb_bus_method_call(GDBusConnection*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar*,
+                               GVariant*,
+                               GDBusMethodInvocation*,
+                               void*);
+
+/* Bus functions */
+static void bus_ref(plugin_t*);
+static void bus_unref(plugin_t*);
+static void bus_acquired(plugin_t*, GDBusConnection*);
+static void bus_name_lost(plugin_t*, GDBusConnection*);
+static void bus_samples_changed();
+static void bus_notify(const gchar*, const gchar*, const gchar*, guint8);
+
+/* Snapshot functions */
+static void snapshot_ref(plugin_t*);
+static void snapshot_unref(plugin_t*);
+static void snapshot_publish();
+
+/* Probe functions */
+static gint64 probe_now();
+static void   probe_add(guint, gint64);
+static void   probe_record(guint, gint64);
+static gchar* probe_report();
+
+/* Scanner callbacks */
+static gboolean cb_scanner_timer_tick(void*);
+static gboolean cb_scanner_pause(void*);
+static void     cb_scanner_done(GObject*, GAsyncResult*, void*);
+static gboolean cb_walk_settle(gpointer, gpointer, gpointer);
+
+/* Scanner functions */
+static void     scanner_ref();
+static void     scanner_unref();
+static void     scanner_request();
+static void     scanner_slice();
+static gboolean scanner_timer_tick();
 
 /* Opts functions */
 static void opts_enable_toggled(opts_t*, gboolean);
@@ -171,12 +731,36 @@ static void opts_icon_toggled(opts_t*, gboolean);
 static void opts_period_changed(opts_t*, double);
 static void opts_border_changed(opts_t*, guint);
 static void opts_padding_changed(opts_t*, guint);
+static void opts_themed_toggled(opts_t*, gboolean);
+static void opts_ramp_toggled(opts_t*, gboolean);
+static void opts_pressure_toggled(opts_t*, gboolean);
+static void opts_adaptive_toggled(opts_t*, gboolean);
+static void opts_ceiling_changed(opts_t*, double);
+static void opts_display_changed(opts_t*, guint);
+static void opts_cgroup_changed(opts_t*, const gchar*);
+static void opts_warning_changed(opts_t*, guint);
+static void opts_critical_changed(opts_t*, guint);
+static void opts_thresholds_check(opts_t*);
+static void opts_notify_toggled(opts_t*, gboolean);
+static void opts_rate_changed(opts_t*, guint);
+
+/* Reading functions */
+static gboolean reading_read(reading_t*, const meminfo_t*);
+static void     reading_delete(reading_t*);
 
 /* Monitor functions */
-static gboolean monitor_gen_tooltip_ram(monitor_t*, GtkTooltip*);
-static gboolean monitor_gen_tooltip_swap(monitor_t*, GtkTooltip*);
+static gboolean monitor_gen_tooltip(monitor_t*, GtkTooltip*);
+static void monitor_sample(monitor_t*, gboolean, gint64);
+static void monitor_sync(monitor_t*);
 static void monitor_update_gui(monitor_t*);
-static void monitor_update_timer(monitor_t*);
+static void  monitor_update_timer(monitor_t*);
+static guint monitor_get_period(monitor_t*);
+static void  monitor_set_period(monitor_t*, guint);
+static void  monitor_burst(monitor_t*, guint);
+static void  monitor_update_level(monitor_t*, guint);
+static void monitor_invalidate(monitor_t*);
+static void monitor_reopen(monitor_t*);
+static void monitor_set_cgroup(monitor_t*, const gchar*);
 static void monitor_construct(monitor_t*, guint, plugin_t*);
 static void monitor_delete(monitor_t*);
 
@@ -184,6 +768,7 @@ static void monitor_delete(monitor_t*);
 static plugin_t* plugin_new(guint);
 static void      plugin_construct(plugin_t*, XfcePanelPlugin*);
 static void      plugin_update_gui(plugin_t*);
+static void      plugin_update_pixbufs(plugin_t*);
 static void      plugin_update_timer(plugin_t*);
 static void      plugin_update(plugin_t*);
 static void      plugin_delete(plugin_t*);
@@ -191,6 +776,13 @@ static gboolean
             plugin_handle_remote_event(plugin_t*, const gchar*, const GValue*);
 static void plugin_handle_reorient(plugin_t*, GtkOrientation);
 static void plugin_handle_resize(plugin_t*, int);
+static void plugin_handle_theme_change(plugin_t*);
+static void plugin_handle_pixbufs_loaded(plugin_t*);
+static void plugin_handle_remove(plugin_t*);
+static void plugin_handle_method_call(plugin_t*,
+                                      const gchar*,
+                                      GVariant*,
+                                      GDBusMethodInvocation*);
 static void plugin_opts_read(plugin_t*);
 static void plugin_opts_write(plugin_t*);
 
@@ -198,19 +790,17 @@ static void plugin_opts_write(plugin_t*);
 static void config_dialog_update_gui(config_t*);
 static void config_dialog_add_appearance(plugin_t*, GtkWidget*);
 static void config_dialog_add_monitor(monitor_t*, GtkWidget*);
+static void config_dialog_add_diagnostics(plugin_t*, GtkWidget*);
+static void config_dialog_update_diagnostics(plugin_t*);
 static void config_dialog_construct(plugin_t*);
 static void config_dialog_response(plugin_t*, GtkWidget*, int);
 
-/* Stats functions */
-static gboolean stats_read_ram(stats_t*);
-static gboolean stats_read_swap(stats_t*);
-
 /* Specifications for the monitors */
 typedef struct {
-  const gchar* name;
-  const gchar* icon;
-  gboolean (*stats_read)(stats_t*);
-  gboolean (*gen_tooltip)(monitor_t*, GtkTooltip*);
+  const gboolean enable; /* Whether the monitor is enabled by default */
+  tooltip_gen_func_t gen_tooltip;
+  const gboolean processes; /* Show the largest processes in the tooltip */
+  const gboolean split;     /* Draw a ring for each NUMA node in the dial */
   struct {
     struct {
       const gchar* label;
@@ -220,296 +810,1835 @@ typedef struct {
       const gchar* label;
       const gchar* tooltip;
     } icon;
+    struct {
+      const gchar* label;
+      const gchar* tooltip;
+    } cgroup;
   } config;
 } spec_t;
 
 static constexpr spec_t spec[app.monitors] = {
     {
-        "RAM",                    /* name */
-        "xfce-applet-memory-ram", /* icon */
-        stats_read_ram,           /* stats_read() */
-        monitor_gen_tooltip_ram,  /* gen_tooltip() */
+        TRUE,            /* enable */
+        tooltip_gen_ram, /* gen_tooltip() */
+        TRUE,            /* processes */
+        FALSE,           /* split */
+        {
+            {"Enable RAM monitor", "Enable the RAM monitor"},     /* enable */
+            {"Show RAM icon", "Show the RAM icon in the plugin"}, /* icon */
+            {NULL, NULL}                                          /* cgroup */
+        }                                                         /* config */
+    },                                                            /* [0] */
+    {
+        TRUE,             /* enable */
+        tooltip_gen_swap, /* gen_tooltip() */
+        FALSE,            /* processes */
+        FALSE,            /* split */
+        {
+            {"Enable Swap monitor", "Enable the Swap monitor"},     /* enable */
+            {"Show swap icon", "Show the swap icon in the plugin"}, /* icon */
+            {NULL, NULL}                                            /* cgroup */
+        }                                                           /* config */
+    },                                                              /* [1] */
+    {
+        FALSE,              /* enable */
+        tooltip_gen_cgroup, /* gen_tooltip() */
+        FALSE,              /* processes */
+        FALSE,              /* split */
+        {
+            {"Enable cgroup monitor", "Enable the cgroup monitor"}, /* enable */
+            {"Show cgroup icon",
+             "Show the cgroup icon in the plugin"}, /* icon */
+            {"Cgroup", "Path of the cgroup relative to /sys/fs/cgroup"}
+            /* cgroup */
+        } /* config */
+    },    /* [2] */
+    {
+        FALSE,               /* enable */
+        tooltip_gen_meminfo, /* gen_tooltip() */
+        FALSE,               /* processes */
+        FALSE,               /* split */
+        {
+            {"Enable shared memory monitor",
+             "Enable the shared memory monitor"}, /* enable */
+            {"Show shared memory icon",
+             "Show the shared memory icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [3] */
+    {
+        FALSE,               /* enable */
+        tooltip_gen_meminfo, /* gen_tooltip() */
+        FALSE,               /* processes */
+        FALSE,               /* split */
+        {
+            {"Enable dirty memory monitor",
+             "Enable the dirty memory monitor"}, /* enable */
+            {"Show dirty memory icon",
+             "Show the dirty memory icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [4] */
+    {
+        FALSE,               /* enable */
+        tooltip_gen_meminfo, /* gen_tooltip() */
+        FALSE,               /* processes */
+        FALSE,               /* split */
+        {
+            {"Enable anonymous memory monitor",
+             "Enable the anonymous memory monitor"}, /* enable */
+            {"Show anonymous memory icon",
+             "Show the anonymous memory icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [5] */
+    {
+        FALSE,               /* enable */
+        tooltip_gen_meminfo, /* gen_tooltip() */
+        FALSE,               /* processes */
+        FALSE,               /* split */
+        {
+            {"Enable locked memory monitor",
+             "Enable the locked memory monitor"}, /* enable */
+            {"Show locked memory icon",
+             "Show the locked memory icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [6] */
+    {
+        FALSE,               /* enable */
+        tooltip_gen_meminfo, /* gen_tooltip() */
+        FALSE,               /* processes */
+        FALSE,               /* split */
+        {
+            {"Enable committed memory monitor",
+             "Enable the committed memory monitor"}, /* enable */
+            {"Show committed memory icon",
+             "Show the committed memory icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [7] */
+    {
+        FALSE,            /* enable */
+        tooltip_gen_zram, /* gen_tooltip() */
+        FALSE,            /* processes */
+        FALSE,            /* split */
         {
-            {"Enable RAM monitor", "Enable the RAM monitor"},    /* enable */
-            {"Show RAM icon", "Show the RAM icon in the plugin"} /* icon */
-        }                                                        /* config */
-    },                                                           /* [0] */
+            {"Enable compressed swap monitor",
+             "Enable the zram and zswap monitor"}, /* enable */
+            {"Show compressed swap icon",
+             "Show the compressed swap icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [8] */
     {
-        "Swap",                    /* name */
-        "xfce-applet-memory-swap", /* icon */
-        stats_read_swap,           /* stats_read() */
-        monitor_gen_tooltip_swap,  /* gen_tooltip() */
+        FALSE,            /* enable */
+        tooltip_gen_numa, /* gen_tooltip() */
+        FALSE,            /* processes */
+        TRUE,             /* split */
         {
-            {"Enable Swap monitor", "Enable the Swap monitor"},    /* enable */
-            {"Show swap icon", "Show the swap icon in the plugin"} /* icon */
-        }                                                          /* config */
-    }                                                              /* [1] */
+            {"Enable NUMA monitor",
+             "Enable the monitor with a dial for each NUMA node"}, /* enable */
+            {"Show NUMA icon", "Show the NUMA icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    },                   /* [9] */
+    {
+        FALSE,              /* enable */
+        tooltip_gen_vmstat, /* gen_tooltip() */
+        FALSE,              /* processes */
+        FALSE,              /* split */
+        {
+            {"Enable swap activity monitor",
+             "Enable the monitor of swapping and major faults"}, /* enable */
+            {"Show swap activity icon",
+             "Show the swap activity icon in the plugin"}, /* icon */
+            {NULL, NULL} /* cgroup */
+        }                /* config */
+    }                    /* [10] */
 };
 
-static const guint RAM = 0;
+static const guint RAM = STATS_RAM;
 
-static gboolean
-match_field(const gchar* line, const gchar* label, gulong* out) {
-  if(g_ascii_strncasecmp(line, label, strlen(label)) == 0) {
-    sscanf(line, "%*s %lu", out);
-    *out = *out * 1024; /* The values in the file are in kB */
-    return TRUE;
+static sampler_t sampler = {0, 0, 0, 0, -1, 0, {-1, NULL}};
+
+static scanner_t scanner;
+
+static probe_t probe;
+
+static bus_t bus;
+
+static snapshot_t snapshot;
+
+static gboolean history_is_valid(const history_header_t* header) {
+  return header->magic == app.history.magic &&
+         header->version == app.history.version &&
+         header->capacity == app.history.capacity;
+}
+
+static void history_reset(history_t* history) {
+  history_header_t* header = history->header;
+
+  memset(history->samples, 0, app.history.capacity * sizeof(sample_t));
+  header->version  = app.history.version;
+  header->capacity = app.history.capacity;
+  header->reserved = 0;
+  header->cursor   = 0;
+  header->magic    = app.history.magic;
+}
+
+/* If file is NULL, the history is only kept in memory */
+static void history_init(history_t* history, const gchar* file) {
+  gsize size = sizeof(history_header_t) +
+               app.history.capacity * sizeof(sample_t);
+  void* map = MAP_FAILED;
+  gint  fd  = -1;
+
+  if(file && (fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) != -1) {
+    /* A new file is filled with zeros, so it will fail the header check and
+       be reset below */
+    if(ftruncate(fd, size) == 0)
+      map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
   }
-  return FALSE;
+
+  if(map != MAP_FAILED) {
+    history->header = (history_header_t*)map;
+    history->file   = g_strdup(file);
+  } else {
+    history->header = (history_header_t*)g_malloc0(size);
+    history->file   = NULL;
+  }
+  history->samples = (sample_t*)(history->header + 1);
+  history->size    = size;
+
+  if(!history_is_valid(history->header))
+    history_reset(history);
 }
 
-static guint get_pixbuf_index(gulong total, gulong available) {
-  guint percent = 0;
+static void history_delete(history_t* history) {
+  if(history->file)
+    munmap(history->header, history->size);
+  else
+    g_free(history->header);
+  g_free(history->file);
+  history->header  = NULL;
+  history->samples = NULL;
+  history->file    = NULL;
+}
+
+static guint history_get_count(const history_t* history) {
+  return MIN((guint32)history->header->cursor, app.history.capacity);
+}
 
-  if(total)
-    percent = ((total - available) * 100 / total);
-  return percent / 5;
+static void history_push(history_t* history, guint32 value) {
+  history_header_t* header   = history->header;
+  guint64           cursor   = header->cursor;
+  guint32           written  = cursor;
+  guint32           last     = cursor >> 32;
+  guint32           time     = g_get_real_time() / G_USEC_PER_SEC;
+  guint32           delta    = 0;
+  guint             capacity = app.history.capacity;
+
+  if(written && time > last)
+    delta = MIN(time - last, G_MAXUINT16);
+  history->samples[written % capacity] = (delta << 16) | (value & 0xffff);
+
+  /* Keep the count bounded without moving the position of the next sample */
+  written++;
+  if(written >= 2 * capacity)
+    written -= capacity;
+
+  /* The sample only becomes visible with this store, so a crash at any point
+     leaves a consistent history behind */
+  __atomic_store_n(&header->cursor, ((guint64)time << 32) | written,
+                   __ATOMIC_RELEASE);
 }
 
-static GdkPixbuf*
-get_pixbuf(const gchar* base, GtkIconTheme* theme, guint size) {
-  GdkPixbuf*   pb   = NULL;
-  GtkIconInfo* info = NULL;
-  const gchar* icon = NULL;
+/* Returns the value of a sample. The most recent sample is at 0 */
+static guint32 history_get(const history_t* history, guint i) {
+  guint32 written = history->header->cursor;
 
-  if((info = gtk_icon_theme_lookup_icon(theme, base, size,
-                                        static_cast<GtkIconLookupFlags>(0)))) {
-    icon = gtk_icon_info_get_filename(info);
-    pb   = gdk_pixbuf_new_from_file_at_scale(icon, size, size, TRUE, NULL);
+  return history->samples[(written - 1 - i) % app.history.capacity] & 0xffff;
+}
 
-    g_object_unref(G_OBJECT(info));
+static gchar* get_history_file(XfcePanelPlugin* xfce, guint id) {
+  gchar* rc   = NULL;
+  gchar* name = NULL;
+  gchar* file = NULL;
+
+  if((rc = xfce_panel_plugin_save_location(xfce, TRUE))) {
+    if(g_str_has_suffix(rc, ".rc"))
+      rc[strlen(rc) - strlen(".rc")] = '\0';
+    name = g_ascii_strdown(stats_spec[id].name, -1);
+    file = g_strdup_printf("%s-%s%s", rc, name, app.history.suffix);
+    g_free(name);
+    g_free(rc);
   }
 
-  return pb;
+  return file;
+}
+
+static void graph_draw_column(graph_t* graph, guint x, guint32 value) {
+  cairo_t* cr = cairo_create(graph->surface);
+  gdouble  p  = MIN(value, 10000) / 10000.0;
+  gdouble  h  = graph->height * p;
+
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_rgba(cr, 0.5, 0.5, 0.5, 0.35);
+  cairo_rectangle(cr, x, 0, 1, graph->height - h);
+  cairo_fill(cr);
+  set_source_usage(cr, p, graph->ramp, NULL);
+  cairo_rectangle(cr, x, graph->height - h, 1, h);
+  cairo_fill(cr);
+  cairo_destroy(cr);
 }
 
-static const gchar* get_units(gulong val) {
-  const gulong kb = 1024;
-  const gulong mb = 1024 * kb;
-  const gulong gb = 1024 * mb;
-  const gulong tb = 1024 * gb;
+static void graph_delete(graph_t* graph) {
+  if(graph->surface)
+    cairo_surface_destroy(graph->surface);
+  graph->surface = NULL;
+  graph->width   = 0;
+  graph->height  = 0;
+}
 
-  if(val > tb)
-    return "TB";
-  else if(val > gb)
-    return "GB";
-  else if(val > mb)
-    return "MB";
-  else if(val > kb)
-    return "KB";
-  else
-    return "B";
+/* Recreates the surface and draws the whole history into it. This is only
+   done when the size or the colours of the graph change */
+static void graph_resize(graph_t*         graph,
+                         guint            width,
+                         guint            height,
+                         gboolean         ramp,
+                         const history_t* history) {
+  guint x = 0;
+
+  graph_delete(graph);
+  if(!width || !height)
+    return;
+
+  graph->surface =
+      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  graph->width  = width;
+  graph->height = height;
+  graph->ramp   = ramp;
+  for(x = 0; x < width && x < history_get_count(history); x++)
+    graph_draw_column(graph, width - 1 - x, history_get(history, x));
+}
+
+/* Shifts the graph left by one column and draws the new sample at the right
+   edge */
+static void graph_push(graph_t* graph, guint32 value) {
+  guchar* data   = NULL;
+  gint    stride = 0;
+  guint   y      = 0;
+
+  if(!graph->surface)
+    return;
+
+  cairo_surface_flush(graph->surface);
+  data   = cairo_image_surface_get_data(graph->surface);
+  stride = cairo_image_surface_get_stride(graph->surface);
+  for(y = 0; y < graph->height; y++)
+    memmove(data + y * stride, data + y * stride + 4, (graph->width - 1) * 4);
+  cairo_surface_mark_dirty(graph->surface);
+
+  graph_draw_column(graph, graph->width - 1, value);
+}
+
+/* In ns */
+static gint64 probe_now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-static gdouble get_value(gdouble value) {
-  if(value < 1024)
-    return value;
-  return get_value(value / 1024);
+/* Only called on the main thread. The stages that run on the sampler thread
+   are timed there and added once they have come back */
+static void probe_add(guint stage, gint64 ns) {
+  timing_t* timing = &probe.timings[stage];
+  guint     bucket = g_bit_storage((gulong)(ns / 1000));
+
+  if(!timing->count || ns < timing->min)
+    timing->min = ns;
+  timing->max = MAX(timing->max, ns);
+  timing->total += ns;
+  timing->count++;
+  timing->buckets[ns < 1000 ? 0 : MIN(bucket, app.probe.buckets - 1)]++;
 }
 
-static gboolean stats_read_ram(stats_t* stats) {
-  FILE* fp = NULL;
-  gchar line[256];
-  guint read   = 0;
-  guint fields = 5;
+static void probe_record(guint stage, gint64 start) {
+  probe_add(stage, probe_now() - start);
+}
 
-  if((fp = fopen(app.meminfo, "r"))) {
-    while(fgets(line, 256, fp) && read < fields) {
-      read += (match_field(line, "MemTotal", &stats->total) ||
-               match_field(line, "MemAvailable", &stats->available) ||
-               match_field(line, "MemFree", &stats->ram.free) ||
-               match_field(line, "Buffers", &stats->ram.buffered) ||
-               match_field(line, "Cached", &stats->ram.cached));
+/* The resident set size of the process in bytes */
+static gulong probe_get_rss() {
+  gchar  buf[128];
+  gulong size     = 0;
+  gulong resident = 0;
+  FILE*  file     = NULL;
+
+  if(!(file = fopen(app.probe.statm, "re")))
+    return 0;
+  if(!fgets(buf, sizeof(buf), file) ||
+     sscanf(buf, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  fclose(file);
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* Returns a newly allocated plain text report of everything that has been
+   measured so far. The times are in us */
+static gchar* probe_report() {
+  GString*        report = g_string_new(NULL);
+  const timing_t* timing = NULL;
+  const gchar*    units  = NULL;
+  gdouble         rss    = get_scaled(probe_get_rss(), &units);
+  guint           i      = 0;
+  guint           j      = 0;
+
+  g_string_append_printf(report, "%-16s %10s %10s %10s %10s\n", "stage",
+                         "count", "min", "avg", "max");
+  for(i = 0; i < PROBE_STAGES; i++) {
+    timing = &probe.timings[i];
+    g_string_append_printf(
+        report, "%-16s %10" G_GUINT64_FORMAT " %10.1f %10.1f %10.1f\n",
+        app.probe.stages[i], timing->count, timing->min / 1000.0,
+        timing->count ? (gdouble)timing->total / timing->count / 1000.0 : 0,
+        timing->max / 1000.0);
+  }
+
+  g_string_append(report, "\nhistogram (us)\n");
+  for(i = 0; i < PROBE_STAGES; i++) {
+    timing = &probe.timings[i];
+    g_string_append_printf(report, "%-16s", app.probe.stages[i]);
+    for(j = 0; j < app.probe.buckets; j++)
+      if(timing->buckets[j])
+        g_string_append_printf(report, " %s%u:%" G_GUINT64_FORMAT,
+                               j + 1 < app.probe.buckets ? "<" : ">=",
+                               j + 1 < app.probe.buckets ? 1u << j
+                                                         : 1u << (j - 1),
+                               timing->buckets[j]);
+    g_string_append(report, "\n");
+  }
+
+  g_string_append_printf(report, "\n%-16s %10" G_GUINT64_FORMAT "\n",
+                         "wakeups", probe.wakeups);
+  g_string_append_printf(report, "%-16s %8.1f %s", "rss", rss, units);
+
+  return g_string_free(report, FALSE);
+}
+
+static gboolean ring_open(ring_t* ring, int flags) {
+  ring->head = 0;
+  ring->tail = 0;
+  ring->fd   = eventfd(0, EFD_CLOEXEC | flags);
+  return ring->fd >= 0;
+}
+
+static void ring_close(ring_t* ring) {
+  if(ring->fd >= 0)
+    close(ring->fd);
+  ring->fd = -1;
+}
+
+/* Called by the producer. The slot is filled in before the head is moved
+   past it so the consumer never sees half a tick. Returns FALSE if the ring
+   is full */
+static gboolean ring_push(ring_t* ring, const tick_t* tick) {
+  guint head = ring->head;
+  guint tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if(head - tail == app.sampler.slots)
+    return FALSE;
+
+  ring->slots[head % app.sampler.slots] = *tick;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return ring_signal(ring);
+}
+
+/* Called by the consumer. Returns FALSE if the ring is empty */
+static gboolean ring_pop(ring_t* ring, tick_t* tick) {
+  guint tail = ring->tail;
+  guint head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  if(tail == head)
+    return FALSE;
+
+  *tick = ring->slots[tail % app.sampler.slots];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return TRUE;
+}
+
+/* Wakes up the consumer if it is waiting */
+static gboolean ring_signal(ring_t* ring) {
+  guint64 one = 1;
+
+  return write(ring->fd, &one, sizeof(one)) == sizeof(one);
+}
+
+/* Called by the consumer before it empties the ring, so that anything that
+   is pushed after that signals the eventfd again. If the eventfd blocks,
+   this waits until something has been pushed */
+static gboolean ring_wait(ring_t* ring) {
+  guint64 count = 0;
+
+  return read(ring->fd, &count, sizeof(count)) == sizeof(count);
+}
+
+/* This is the only place where the files of the monitors are read. It runs
+   on the sampler thread, unless that could not be started, in which case
+   the reader is the one of the sampler */
+static void sampler_read(meminfo_reader_t* reader, tick_t* tick) {
+  const meminfo_t* meminfo = NULL;
+  job_t*           job     = NULL;
+  gint64           start   = probe_now();
+  guint            i       = 0;
+
+  tick->valid      = meminfo_reader_read(reader, &tick->meminfo);
+  tick->time       = g_get_real_time();
+  tick->ns_meminfo = probe_now() - start;
+  meminfo          = tick->valid ? &tick->meminfo : NULL;
+  for(i = 0; i < tick->count; i++) {
+    job            = tick->jobs[i];
+    start          = probe_now();
+    tick->ok[i]    = job->read(meminfo, job->data);
+    tick->times[i] = g_get_monotonic_time();
+    tick->ns[i]    = probe_now() - start;
+  }
+}
+
+/* Releases the jobs in the tick that were dropped while it was in flight */
+static void sampler_release(tick_t* tick) {
+  guint i = 0;
+
+  for(i = 0; i < tick->count; i++)
+    if(tick->jobs[i]->dropped)
+      tick->jobs[i]->release(tick->jobs[i]->data);
+}
+
+/* Hands a tick that has been read to its subscribers. Any of them that were
+   unsubscribed while it was being read are only told that the read is over,
+   as if it had failed, so that they can let go of what it was using. The
+   jobs of those that have gone away are released. Whether each of them
+   could be read is up to the subscriber, since not all of them depend on
+   /proc/meminfo */
+static void sampler_complete(tick_t* tick) {
+  subscriber_t* sub = NULL;
+  guint         i   = 0;
+
+  sampler.pending--;
+  for(i = 0; i < tick->count; i++)
+    if(!tick->jobs[i]->dropped)
+      tick->subs[i]->pending = FALSE;
+
+  sampler.time = tick->time;
+  probe_add(PROBE_MEMINFO, tick->ns_meminfo);
+  /* Subscribers may change their period when they are notified */
+  for(i = 0; i < tick->count; i++) {
+    sub = tick->subs[i];
+    if(tick->jobs[i]->dropped)
+      continue;
+    if(!g_slist_find(sampler.subscribers, sub)) {
+      sub->notify(FALSE, tick->times[i], sub->data);
+      continue;
     }
-    fclose(fp);
+    probe_add(PROBE_STATS, tick->ns[i]);
+    sub->notify(tick->ok[i], tick->times[i], sub->data);
+    sub->due = tick->due + (gint64)sampler_get_period(sub) * 1000;
+  }
+  sampler_release(tick);
+  sampler_update_timer();
+  snapshot_publish();
+  bus_samples_changed();
+}
+
+/* Hands the tick to the sampler thread. Nothing is queued if as many ticks
+   as there are slots are still in flight. The subscribers in it then stay
+   due for the next tick, so that a thread that is stuck in a read does not
+   have a backlog of them waiting by the time it gets out */
+static void sampler_post(tick_t* tick) {
+  guint i = 0;
+
+  if(sampler.pending == app.sampler.slots)
+    return;
+
+  for(i = 0; i < tick->count; i++)
+    tick->subs[i]->pending = TRUE;
+  sampler.pending++;
+  if(sampler.worker) {
+    ring_push(&sampler.worker->todo, tick);
+  } else {
+    sampler_read(&sampler.reader, tick);
+    sampler_complete(tick);
   }
+}
 
-  return read == fields;
+/* If a PSI trigger is in use, the subscribers that are woken up by it only
+   need to be polled slowly unless a burst has been asked for. The others
+   are still polled at their own period */
+static guint sampler_get_period(subscriber_t* sub) {
+  if(sampler.psi >= 0 && sub->pressure && sub->period > app.burst.period)
+    return MAX(sub->period, app.pressure.period);
+  return sub->period;
 }
 
-static gboolean stats_read_swap(stats_t* stats) {
-  FILE* fp = NULL;
-  gchar line[256];
-  guint read   = 0;
-  guint fields = 3;
+/* Subscribers that are due before the next tick are notified now so that the
+   ones with the same period stay aligned to a single read */
+static gboolean
+sampler_is_due(subscriber_t* sub, gint64 now, gboolean pressure) {
+  gint64 slack = (gint64)sampler.period * 1000 / 2;
+
+  return (pressure && sub->pressure) || sub->due <= now + slack;
+}
 
-  read = 0;
-  if((fp = fopen(app.meminfo, "r"))) {
-    while(fgets(line, 256, fp) && read < fields) {
-      read += (match_field(line, "SwapTotal", &stats->total) ||
-               match_field(line, "SwapFree", &stats->available) ||
-               match_field(line, "SwapCached", &stats->swap.cached));
+/* Queues a read of /proc/meminfo and of every subscriber that is due. If
+   pressure is set, the subscribers that asked to be notified on memory
+   pressure are due regardless. A subscriber whose last read has not come
+   back yet is never due */
+static void sampler_tick(gboolean pressure) {
+  GSList*       l    = NULL;
+  subscriber_t* sub  = NULL;
+  tick_t        tick = {};
+
+  probe.wakeups++;
+  tick.due = g_get_monotonic_time();
+  for(l = sampler.subscribers; l; l = l->next) {
+    sub = (subscriber_t*)l->data;
+    if(!sub->pending && sampler_is_due(sub, tick.due, pressure)) {
+      tick.subs[tick.count]   = sub;
+      tick.jobs[tick.count++] = sub->job;
+    }
+    if(tick.count && (tick.count == app.sampler.batch || !l->next)) {
+      sampler_post(&tick);
+      tick.count = 0;
     }
-    fclose(fp);
   }
+}
+
+/* Empties the queue of ticks that have been read. Returns whether there
+   were any */
+static gboolean sampler_drain() {
+  tick_t   tick;
+  gboolean drained = FALSE;
 
-  return read == fields;
+  ring_wait(&sampler.worker->done);
+  while(ring_pop(&sampler.worker->done, &tick)) {
+    sampler_complete(&tick);
+    drained = TRUE;
+  }
+  return drained;
 }
 
-static void pixbufs_create(pixbufs_t* pixbufs, plugin_t* plugin) {
-  guint            size, i;
-  GtkIconTheme*    theme = NULL;
-  XfcePanelPlugin* xfce  = plugin->xfce;
+static void sampler_close_pressure() {
+  if(sampler.psi_watch)
+    g_source_remove(sampler.psi_watch);
+  if(sampler.psi >= 0)
+    close(sampler.psi);
+  sampler.psi_watch = 0;
+  sampler.psi       = -1;
+}
 
-  size = 96;
-  theme =
-      gtk_icon_theme_get_for_screen(gtk_widget_get_screen(GTK_WIDGET(xfce)));
-  for(i = 0; i < app.monitors; i++)
-    pixbufs->tooltips[i] = get_pixbuf(spec[i].icon, theme, size);
+/* Registers a PSI trigger so that the kernel wakes us up when memory is under
+   pressure. This fails if PSI is not available or the trigger is not
+   permitted, in which case the sampler just keeps polling */
+static void sampler_open_pressure() {
+  const gchar* trigger = app.pressure.trigger;
+
+  if(sampler.psi >= 0)
+    return;
+
+  sampler.psi = open(app.pressure.file, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if(sampler.psi < 0)
+    return;
+
+  if(write(sampler.psi, trigger, strlen(trigger) + 1) < 0) {
+    sampler_close_pressure();
+    return;
+  }
+  sampler.psi_watch = g_unix_fd_add(
+      sampler.psi, (GIOCondition)(G_IO_PRI | G_IO_ERR), cb_sampler_pressure,
+      NULL);
 }
 
-static void pixbufs_update(pixbufs_t* pixbufs, plugin_t* plugin) {
-  guint            i       = 0;
-  GtkIconTheme*    theme   = NULL;
-  gchar*           base    = NULL;
-  monitor_t*       monitor = &plugin->monitors[RAM];
-  opts_t*          opts    = &monitor->opts;
-  guint            border  = opts->border;
-  guint            padding = opts->padding;
-  XfcePanelPlugin* xfce    = plugin->xfce;
-  guint            size, size_icon, size_dial;
+static void sampler_update_pressure() {
+  GSList*  l        = NULL;
+  gboolean pressure = FALSE;
 
-  size      = xfce_panel_plugin_get_size(xfce);
-  size_icon = size - border * 2 - padding * 2;
-  size_dial = size - border * 2 - padding * 2;
-  theme =
-      gtk_icon_theme_get_for_screen(gtk_widget_get_screen(GTK_WIDGET(xfce)));
+  for(l = sampler.subscribers; l; l = l->next)
+    pressure |= ((subscriber_t*)l->data)->pressure;
 
-  pixbufs_delete(pixbufs);
+  if(pressure)
+    sampler_open_pressure();
+  else
+    sampler_close_pressure();
+}
+
+/* The timer runs at the shortest period of all the subscribers. The timer
+   has a resolution of a second so that the wakeups can be coalesced with
+   other timers. Only bursts need anything finer */
+static void sampler_update_timer() {
+  GSList* l      = NULL;
+  guint   period = 0;
+  guint   p      = 0;
+
+  for(l = sampler.subscribers; l; l = l->next) {
+    p = sampler_get_period((subscriber_t*)l->data);
+    if(!period || p < period)
+      period = p;
+  }
+
+  if(sampler.timer && period != sampler.period) {
+    g_source_remove(sampler.timer);
+    sampler.timer = 0;
+  }
+  if(period && !sampler.timer && period < 1000)
+    sampler.timer = g_timeout_add(period, cb_sampler_timer_tick, NULL);
+  else if(period && !sampler.timer)
+    sampler.timer = g_timeout_add_seconds((period + 999) / 1000,
+                                          cb_sampler_timer_tick, NULL);
+  sampler.period = period;
+}
+
+/* Defer the read to an idle callback so that several monitors being
+   (re-)subscribed together still result in a single read */
+static void sampler_schedule() {
+  if(!sampler.idle)
+    sampler.idle = g_idle_add(cb_sampler_idle, NULL);
+}
+
+/* Returns NULL if the rings could not be opened */
+static worker_t* worker_new() {
+  worker_t* worker = g_new0(worker_t, 1);
+
+  worker->todo.fd = -1;
+  worker->done.fd = -1;
+  worker->refs    = 2;
+  meminfo_reader_init(&worker->reader, sampler.reader.file);
+  if(!ring_open(&worker->todo, 0) ||
+     !ring_open(&worker->done, EFD_NONBLOCK)) {
+    worker_delete(worker);
+    return NULL;
+  }
+  return worker;
+}
+
+/* Called by each of the threads once it is done with the worker, so that
+   the last one to let go of it frees it */
+static void worker_unref(worker_t* worker) {
+  if(!__atomic_sub_fetch(&worker->refs, 1, __ATOMIC_ACQ_REL))
+    worker_delete(worker);
+}
+
+/* By the time the worker is deleted, every tick that is still in it belongs
+   to subscribers that have gone away */
+static void worker_delete(worker_t* worker) {
+  tick_t tick;
+
+  while(ring_pop(&worker->todo, &tick) || ring_pop(&worker->done, &tick))
+    sampler_release(&tick);
+  meminfo_reader_close(&worker->reader);
+  ring_close(&worker->todo);
+  ring_close(&worker->done);
+  g_free(worker);
+}
+
+/* The sampler thread is started with the first reference. If it cannot be,
+   the files are read on the main thread instead */
+static void sampler_ref() {
+  worker_t* worker = NULL;
+  GThread*  thread = NULL;
+
+  if(sampler.refs++)
+    return;
+
+  if(!(worker = worker_new()))
+    return;
+  if(!(thread = g_thread_try_new("sampler", cb_sampler_thread, worker,
+                                 NULL))) {
+    worker_delete(worker);
+    return;
+  }
+  g_thread_unref(thread);
+  sampler.worker = worker;
+  sampler.watch  = g_unix_fd_add(worker->done.fd, G_IO_IN, cb_sampler_done,
+                                 NULL);
+}
+
+/* The sampler thread is not waited for, since it may be stuck in a read.
+   It is told to quit and lets go of the worker once it gets to it. Any
+   ticks that are still in flight are released with the worker */
+static void sampler_unref() {
+  worker_t* worker = sampler.worker;
+
+  if(--sampler.refs)
+    return;
+
+  if(worker) {
+    g_source_remove(sampler.watch);
+    __atomic_store_n(&worker->quit, TRUE, __ATOMIC_RELEASE);
+    ring_signal(&worker->todo);
+    worker_unref(worker);
+  }
+  if(sampler.timer)
+    g_source_remove(sampler.timer);
+  if(sampler.idle)
+    g_source_remove(sampler.idle);
+  meminfo_reader_close(&sampler.reader);
+  sampler_close_pressure();
+  g_slist_free(sampler.subscribers);
+  memset(&sampler, 0, sizeof(sampler_t));
+  meminfo_reader_init(&sampler.reader, NULL);
+  sampler.psi = -1;
+}
+
+static void sampler_subscribe(subscriber_t* sub) {
+  if(!g_slist_find(sampler.subscribers, sub))
+    sampler.subscribers = g_slist_prepend(sampler.subscribers, sub);
+  sub->due = 0;
+  sampler_update_pressure();
+  sampler_update_timer();
+  sampler_schedule();
+}
+
+static void sampler_unsubscribe(subscriber_t* sub) {
+  sampler.subscribers = g_slist_remove(sampler.subscribers, sub);
+  sampler_update_pressure();
+  sampler_update_timer();
+}
+
+/* Called when a subscriber is about to go away for good. Its job is
+   released at once unless a read of it is in flight, in which case that
+   read is left to finish and the job is released when it comes back */
+static void sampler_drop(subscriber_t* sub) {
+  job_t* job = sub->job;
+
+  sampler_unsubscribe(sub);
+  if(sub->pending)
+    job->dropped = TRUE;
+  else
+    job->release(job->data);
+  sub->job     = NULL;
+  sub->pending = FALSE;
+}
+
+/* The loop of the sampler thread. It reads the ticks in the order that they
+   were queued until the main thread lets go of the worker */
+static void sampler_run(worker_t* worker) {
+  tick_t tick;
+
+  while(!__atomic_load_n(&worker->quit, __ATOMIC_ACQUIRE)) {
+    if(!ring_pop(&worker->todo, &tick)) {
+      ring_wait(&worker->todo);
+      continue;
+    }
+    sampler_read(&worker->reader, &tick);
+    ring_push(&worker->done, &tick);
+  }
+  worker_unref(worker);
+}
+
+static const GDBusInterfaceVTable bus_vtable = {cb_bus_method_call, NULL,
+                                                 NULL};
+
+static void bus_register(plugin_t* plugin) {
+  bus_object_t* object = &plugin->bus;
+  gint          id     = xfce_panel_plugin_get_unique_id(plugin->xfce);
+
+  object->path = g_strdup_printf("%s/%d", app.bus.path, id);
+  object->id   = g_dbus_connection_register_object(
+      bus.connection, object->path,
+      g_dbus_node_info_lookup_interface(bus.info, app.bus.interface),
+      &bus_vtable, plugin, NULL, NULL);
+}
+
+static void bus_unregister(plugin_t* plugin) {
+  bus_object_t* object = &plugin->bus;
+
+  if(object->id)
+    g_dbus_connection_unregister_object(bus.connection, object->id);
+  g_free(object->path);
+  object->path = NULL;
+  object->id   = 0;
+}
+
+/* Every name is owned on the same connection, so it is only kept the first
+   time */
+static void bus_acquired(plugin_t* plugin, GDBusConnection* connection) {
+  if(!bus.connection)
+    bus.connection = (GDBusConnection*)g_object_ref(connection);
+  if(!plugin->bus.id)
+    bus_register(plugin);
+}
+
+/* This is also called if there is no session bus, in which case there is
+   nothing to do. The plugin works just the same without it. Otherwise,
+   another process has the same instance, probably a panel that is still
+   exiting. The object remains exported under the unique name of the
+   connection, and the name is taken over if that process releases it */
+static void bus_name_lost(plugin_t* plugin, GDBusConnection* connection) {
+  if(connection)
+    g_warning("%s is owned by another process", plugin->bus.name);
+}
+
+static void bus_ref(plugin_t* plugin) {
+  bus_object_t* object = &plugin->bus;
+  gint          id     = xfce_panel_plugin_get_unique_id(plugin->xfce);
+
+  if(!bus.refs++)
+    bus.info = g_dbus_node_info_new_for_xml(app.bus.xml, NULL);
+  bus.plugins   = g_slist_prepend(bus.plugins, plugin);
+  object->name  = g_strdup_printf("%s.i%d", app.bus.name, id);
+  object->owner = g_bus_own_name(G_BUS_TYPE_SESSION, object->name,
+                                 G_BUS_NAME_OWNER_FLAGS_NONE, cb_bus_acquired,
+                                 NULL, cb_bus_name_lost, plugin, NULL);
+}
+
+static void bus_unref(plugin_t* plugin) {
+  bus_object_t* object = &plugin->bus;
+
+  g_bus_unown_name(object->owner);
+  bus_unregister(plugin);
+  g_free(object->name);
+  object->name  = NULL;
+  object->owner = 0;
+  bus.plugins   = g_slist_remove(bus.plugins, plugin);
+  if(--bus.refs)
+    return;
+
+  if(bus.connection)
+    g_object_unref(bus.connection);
+  g_dbus_node_info_unref(bus.info);
+  memset(&bus, 0, sizeof(bus_t));
+}
+
+/* This is called once per tick regardless of how many monitors were
+   sampled on it */
+static void bus_samples_changed() {
+  bus_object_t* object = NULL;
+  GSList*       l      = NULL;
+
+  for(l = bus.plugins; l; l = l->next) {
+    object = &((plugin_t*)l->data)->bus;
+    if(object->id)
+      g_dbus_connection_emit_signal(bus.connection, NULL, object->path,
+                                    app.bus.interface, "SamplesChanged",
+                                    g_variant_new("(x)", sampler.time), NULL);
+  }
+}
+
+/* Sends a desktop notification over the connection of the bus name. There
+   is nowhere to send it until that has been acquired */
+static void bus_notify(const gchar* icon,
+                       const gchar* summary,
+                       const gchar* body,
+                       guint8       urgency) {
+  const gchar*    actions[] = {NULL};
+  GVariantBuilder hints;
+
+  if(!bus.connection)
+    return;
+
+  g_variant_builder_init(&hints, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&hints, "{sv}", "urgency",
+                        g_variant_new_byte(urgency));
+  g_dbus_connection_call(
+      bus.connection, app.alert.name, app.alert.path, app.alert.interface,
+      "Notify",
+      g_variant_new("(susss^asa{sv}i)", PACKAGE, 0, icon, summary, body,
+                    actions, &hints, -1),
+      NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+}
+
+static void bus_add_field(const gchar* label, gulong value, void* data) {
+  g_variant_builder_add((GVariantBuilder*)data, "{st}", label,
+                        (guint64)value);
+}
+
+/* The stats of the monitors that are not enabled are stale, so only the
+   total and available memory are given for those and they are zero */
+static GVariant* bus_get_snapshot(plugin_t* plugin) {
+  GVariantBuilder monitors;
+  GVariantBuilder fields;
+  monitor_t*      monitor = NULL;
+  stats_t*        stats   = NULL;
+  stats_t         none    = {};
+  guint           i       = 0;
+
+  g_variant_builder_init(&monitors, G_VARIANT_TYPE("a(sbttua{st})"));
+  for(i = 0; i < app.monitors; i++) {
+    monitor = &plugin->monitors[i];
+    stats   = monitor->opts.enable ? &monitor->stats : &none;
+    g_variant_builder_init(&fields, G_VARIANT_TYPE("a{st}"));
+    if(monitor->opts.enable)
+      stats_foreach_field(i, stats, bus_add_field, &fields);
+    g_variant_builder_add(&monitors, "(sbttua{st})", stats_spec[i].name,
+                          monitor->opts.enable, (guint64)stats->total,
+                          (guint64)stats->available,
+                          get_value(stats->total, stats->available), &fields);
+  }
+
+  return g_variant_new("(xa(sbttua{st}))", sampler.time, &monitors);
+}
+
+/* An empty name sets the period of every monitor. See monitor_set_period()
+   for how long it lasts */
+static gboolean
+bus_set_period(plugin_t* plugin, const gchar* name, guint period) {
+  const range_t* range   = &app.config.period;
+  monitor_t*     monitor = NULL;
+  gboolean       found   = FALSE;
+  guint          i       = 0;
+
+  if(period < range->min * 1000 || period > range->max * 1000)
+    return FALSE;
+
+  for(i = 0; i < app.monitors; i++) {
+    monitor = &plugin->monitors[i];
+    if(*name && strcmp(name, stats_spec[i].name) != 0)
+      continue;
+    monitor_set_period(monitor, period);
+    found = TRUE;
+  }
+
+  return found;
+}
+
+static void bus_burst(plugin_t* plugin, guint duration) {
+  guint i = 0;
 
   for(i = 0; i < app.monitors; i++)
-    pixbufs->icons[i] = get_pixbuf(spec[i].icon, theme, size_icon);
-  for(i = 0; i < app.dials.count; i++) {
-    base              = g_strdup_printf(app.dials.base, i * 5);
-    pixbufs->dials[i] = get_pixbuf(base, theme, size_dial);
-    g_free(base);
+    monitor_burst(&plugin->monitors[i], MIN(duration, app.burst.duration));
+}
+
+/* Returns the descriptor of the segment, locked, or -1 if another process
+   holds the lock. The owner unlinks the segment before it releases the
+   lock, so if the lock was only acquired after that, the segment that was
+   opened is no longer the one that readers will find and it is opened
+   again */
+static int snapshot_lock(const gchar* name) {
+  struct stat st;
+  int         fd = -1;
+
+  while((fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) >= 0) {
+    if(flock(fd, LOCK_EX | LOCK_NB) < 0)
+      break;
+    if(fstat(fd, &st) == 0 && st.st_nlink)
+      return fd;
+    close(fd);
   }
+  if(fd >= 0)
+    close(fd);
+
+  return -1;
 }
 
-static void pixbufs_delete(pixbufs_t* pixbufs) {
-  guint i;
+/* A segment left behind by a panel that did not exit cleanly is reused. If
+   it was left halfway through a write, the sequence number is made even
+   again so that readers do not wait for a write that will never finish.
+   This is only safe because no other process can be writing to it while
+   the lock is held */
+static void snapshot_open() {
+  memory_shm_t* shm = NULL;
+  void*         map = MAP_FAILED;
+  gchar         name[64];
+  guint         i  = 0;
+  int           fd = -1;
+
+  memory_shm_get_name(name, sizeof(name));
+  if((fd = snapshot_lock(name)) < 0)
+    return;
+  if(ftruncate(fd, sizeof(memory_shm_t)) == 0)
+    map = mmap(NULL, sizeof(memory_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+  if(map == MAP_FAILED) {
+    shm_unlink(name);
+    close(fd);
+    return;
+  }
 
+  shm                 = (memory_shm_t*)map;
+  shm->size           = sizeof(memory_shm_t);
+  shm->monitors_count = app.monitors;
   for(i = 0; i < app.monitors; i++)
-    if(pixbufs->icons[i])
-      g_object_unref(G_OBJECT(pixbufs->icons[i]));
-  for(i = 0; i < app.dials.count; i++)
-    if(pixbufs->dials[i])
-      g_object_unref(G_OBJECT(pixbufs->dials[i]));
+    g_strlcpy(shm->monitors[i].name, stats_spec[i].name,
+              sizeof(shm->monitors[i].name));
+  if(shm->seq & 1)
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+  shm->version = MEMORY_SHM_VERSION;
+  shm->magic   = MEMORY_SHM_MAGIC;
+  snapshot.shm = shm;
+  snapshot.fd  = fd;
 }
 
-static gboolean monitor_gen_tooltip_ram(monitor_t*  monitor,
-                                        GtkTooltip* tooltip) {
-  stats_t* stats = &monitor->stats;
-  pixbufs_t* pixbufs = monitor->pixbufs;
-  GdkPixbuf* icon = pixbufs->tooltips[monitor->id];
-  gchar* markup;
-
-  markup = g_markup_printf_escaped(
-      "<span><tt>"
-      "<b>%-12s</b>%5.1f %s\n"
-      "<b>%-12s</b>%5.1f %s\n"
-      "<b>%-12s</b>%5.1f %s\n"
-      "<b>%-12s</b>%5.1f %s\n\n"
-      "<b>%-12s</b>%5.1f %s</tt></span>",
-      "Available", get_value(stats->available), get_units(stats->available), //
-      "Free", get_value(stats->ram.free), get_units(stats->ram.free),        //
-      "Buffers", get_value(stats->ram.buffered), get_units(stats->ram.buffered),
-      "Cached", get_value(stats->ram.cached), get_units(stats->ram.cached), //
-      "Total", get_value(stats->total), get_units(stats->total));
-  
-  gtk_tooltip_set_icon(tooltip, icon);
-  gtk_tooltip_set_markup(tooltip, markup);
+static void snapshot_ref(plugin_t* plugin) {
+  if(!snapshot.refs++)
+    snapshot_open();
+  snapshot.plugins = g_slist_append(snapshot.plugins, plugin);
+}
 
-  return TRUE;
+static void snapshot_unref(plugin_t* plugin) {
+  gchar name[64];
+
+  snapshot.plugins = g_slist_remove(snapshot.plugins, plugin);
+  if(--snapshot.refs)
+    return;
+
+  /* Only the owner gets here with a segment. It is unlinked while the lock
+     is still held, so no other process can have taken it over */
+  if(snapshot.shm) {
+    munmap(snapshot.shm, sizeof(memory_shm_t));
+    memory_shm_get_name(name, sizeof(name));
+    shm_unlink(name);
+    close(snapshot.fd);
+  }
+  memset(&snapshot, 0, sizeof(snapshot_t));
 }
 
-static gboolean monitor_gen_tooltip_swap(monitor_t*  monitor,
-                                         GtkTooltip* tooltip) {
-  stats_t* stats = &monitor->stats;
-  pixbufs_t* pixbufs = monitor->pixbufs;
-  GdkPixbuf* icon = pixbufs->tooltips[monitor->id];
-  gchar* markup;
-
-  markup = g_markup_printf_escaped(
-      "<span><tt>"
-      "<b>%-12s</b>%5.1f %s\n"
-      "<b>%-12s</b>%5.1f %s\n\n"
-      "<b>%-12s</b>%5.1f %s</tt></span>",
-      "Available", get_value(stats->available), get_units(stats->available), //
-      "Cached", get_value(stats->swap.cached), get_units(stats->swap.cached), //
-      "Total", get_value(stats->total), get_units(stats->total));
+static void snapshot_add_field(const gchar* label, gulong value, void* data) {
+  memory_shm_monitor_t* m     = (memory_shm_monitor_t*)data;
+  memory_shm_field_t*   field = NULL;
 
-  gtk_tooltip_set_icon(tooltip, icon);
-  gtk_tooltip_set_markup(tooltip, markup);
+  if(m->fields_count < MEMORY_SHM_FIELDS) {
+    field = &m->fields[m->fields_count++];
+    g_strlcpy(field->label, label, sizeof(field->label));
+    field->value = value;
+  }
+}
+
+/* The writer side of the seqlock in memory-shm.h. The sequence number is
+   made odd before anything is written and even again once everything has
+   been written. Like the bus, the stats of monitors that are not enabled
+   are given as zero */
+static void snapshot_publish() {
+  memory_shm_t*         shm     = snapshot.shm;
+  memory_shm_monitor_t* m       = NULL;
+  plugin_t*             plugin  = NULL;
+  monitor_t*            monitor = NULL;
+  stats_t*              stats   = NULL;
+  guint64               seq     = 0;
+  guint                 i       = 0;
+
+  if(!shm || !snapshot.plugins)
+    return;
+
+  plugin = (plugin_t*)snapshot.plugins->data;
+  seq    = shm->seq;
+  __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  shm->time = sampler.time;
+  shm->ticks++;
+  for(i = 0; i < app.monitors; i++) {
+    monitor         = &plugin->monitors[i];
+    stats           = &monitor->stats;
+    m               = &shm->monitors[i];
+    m->enabled      = monitor->opts.enable;
+    m->total        = m->enabled ? stats->total : 0;
+    m->available    = m->enabled ? stats->available : 0;
+    m->value        = get_value(m->total, m->available);
+    m->fields_count = 0;
+    if(m->enabled)
+      stats_foreach_field(i, stats, snapshot_add_field, m);
+  }
+
+  __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
 
+/* Adds a process to the scan if it is one of the largest seen so far. While
+   scanning, the top processes are kept in a min-heap by RSS so the smallest
+   of them is always at the root */
+static void scan_insert(scan_t* scan, gint pid, gulong rss) {
+  process_t* top   = scan->top;
+  process_t  tmp   = {};
+  guint      i     = 0;
+  guint      child = 0;
+
+  if(scan->count < app.scanner.count) {
+    i = scan->count++;
+    top[i].pid = pid;
+    top[i].rss = rss;
+    for(; i && top[(i - 1) / 2].rss > top[i].rss; i = (i - 1) / 2) {
+      tmp              = top[i];
+      top[i]           = top[(i - 1) / 2];
+      top[(i - 1) / 2] = tmp;
+    }
+  } else if(rss > top[0].rss) {
+    top[0].pid = pid;
+    top[0].rss = rss;
+    while((child = 2 * i + 1) < scan->count) {
+      if(child + 1 < scan->count && top[child + 1].rss < top[child].rss)
+        child++;
+      if(top[i].rss <= top[child].rss)
+        break;
+      tmp        = top[i];
+      top[i]     = top[child];
+      top[child] = tmp;
+      i          = child;
+    }
+  }
+}
+
+/* Reads the single line in /proc/[pid]/<name> relative to the /proc fd */
+static ssize_t
+scan_read(int proc, const gchar* pid, const gchar* name, gchar* buf, gsize n) {
+  gchar   path[64];
+  ssize_t len = -1;
+  int     fd  = -1;
+
+  g_snprintf(path, sizeof(path), "%s/%s", pid, name);
+  if((fd = openat(proc, path, O_RDONLY | O_CLOEXEC)) < 0)
+    return -1;
+  len = read(fd, buf, n - 1);
+  close(fd);
+  if(len >= 0)
+    buf[len] = '\0';
+  return len;
+}
+
+/* Only the second field of statm is used */
+static gboolean scan_parse_rss(const gchar* buf, gulong* rss) {
+  const gchar* p = strchr(buf, ' ');
+
+  if(!p)
+    return FALSE;
+  for(p++, *rss = 0; *p >= '0' && *p <= '9'; p++)
+    *rss = *rss * 10 + (*p - '0');
+  *rss *= sysconf(_SC_PAGESIZE);
   return TRUE;
 }
 
-static int monitor_timer_tick(monitor_t* monitor) {
-  opts_t* opts = &monitor->opts;
+static void tracked_close(tracked_t* tracked) {
+  if(tracked->fd >= 0)
+    close(tracked->fd);
+  tracked->fd = -1;
+}
 
-  monitor_update_gui(monitor);
-  if(monitor->timer == 0) {
-    monitor->timer =
-        g_timeout_add(opts->period, cb_monitor_timer_tick, monitor);
+static void tracked_delete(void* data) {
+  tracked_close((tracked_t*)data);
+  g_free(data);
+}
+
+/* Reads the RSS of a process, through its statm if that is open */
+static gboolean tracked_read(tracked_t* tracked, int proc, const gchar* pid) {
+  gchar   buf[128];
+  ssize_t len = -1;
+
+  if(tracked->fd < 0)
+    return scan_read(proc, pid, "statm", buf, sizeof(buf)) > 0 &&
+           scan_parse_rss(buf, &tracked->rss);
+
+  if((len = pread(tracked->fd, buf, sizeof(buf) - 1, 0)) <= 0)
     return FALSE;
+  buf[len] = '\0';
+  return scan_parse_rss(buf, &tracked->rss);
+}
+
+static walk_t* walk_new() {
+  walk_t* walk = g_new0(walk_t, 1);
+
+  walk->tracked =
+      g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                            tracked_delete);
+  return walk;
+}
+
+static void walk_delete(walk_t* walk) {
+  if(walk->dir)
+    closedir(walk->dir);
+  g_hash_table_destroy(walk->tracked);
+  g_free(walk);
+}
+
+/* A process is only read if it is new, if its pid has been reused, if it is
+   at the top or if it is its turn to be refreshed. Otherwise all it costs is
+   a stat of its directory, which unlike reading statm does not need the
+   lock on its memory map */
+static void walk_visit(walk_t* walk, const gchar* name) {
+  int         proc    = dirfd(walk->dir);
+  gint        pid     = atoi(name);
+  tracked_t*  tracked = NULL;
+  gint64      start   = 0;
+  gboolean    stale   = FALSE;
+  struct stat st;
+
+  if(fstatat(proc, name, &st, 0) < 0)
+    return;
+  start = (gint64)st.st_ctim.tv_sec * G_USEC_PER_SEC +
+          st.st_ctim.tv_nsec / 1000;
+
+  tracked = (tracked_t*)g_hash_table_lookup(walk->tracked,
+                                            GINT_TO_POINTER(pid));
+  if(!tracked) {
+    tracked      = g_new0(tracked_t, 1);
+    tracked->pid = pid;
+    tracked->fd  = -1;
+    g_hash_table_insert(walk->tracked, GINT_TO_POINTER(pid), tracked);
+    stale = TRUE;
+  } else if(tracked->start != start) {
+    tracked_close(tracked);
+    tracked->name[0] = '\0';
+    stale            = TRUE;
   }
+  tracked->start = start;
+
+  stale = stale || tracked->fd >= 0 ||
+          (pid + walk->scan) % app.scanner.refresh == 0;
+  if(stale && !tracked_read(tracked, proc, name))
+    return;
+
+  tracked->scan = walk->scan;
+  scan_insert(&walk->top, pid, tracked->rss);
+}
+
+static gboolean walk_is_top(walk_t* walk, gint pid) {
+  guint i = 0;
 
+  for(i = 0; i < walk->top.count; i++)
+    if(walk->top.top[i].pid == pid)
+      return TRUE;
+  return FALSE;
+}
+
+/* Forgets the processes that were not seen in this scan, since they are
+   gone, and keeps the statm of only the ones at the top open */
+static gboolean walk_settle(walk_t* walk, tracked_t* tracked) {
+  gchar pid[16];
+
+  if(tracked->scan != walk->scan)
+    return TRUE;
+
+  if(!walk_is_top(walk, tracked->pid)) {
+    tracked_close(tracked);
+  } else if(tracked->fd < 0) {
+    g_snprintf(pid, sizeof(pid), "%d/statm", tracked->pid);
+    tracked->fd = openat(dirfd(walk->dir), pid, O_RDONLY | O_CLOEXEC);
+  }
+  return FALSE;
+}
+
+/* The names are only read for the processes that end up at the top, and
+   only the first time they get there */
+static void walk_finish(walk_t* walk) {
+  scan_t*    scan    = &walk->top;
+  tracked_t* tracked = NULL;
+  process_t  tmp     = {};
+  gchar      pid[16];
+  gchar*     p = NULL;
+  guint      i = 0;
+  guint      j = 0;
+
+  /* Most memory first */
+  for(i = 1; i < scan->count; i++) {
+    tmp = scan->top[i];
+    for(j = i; j && scan->top[j - 1].rss < tmp.rss; j--)
+      scan->top[j] = scan->top[j - 1];
+    scan->top[j] = tmp;
+  }
+
+  g_hash_table_foreach_remove(walk->tracked, cb_walk_settle, walk);
+  for(i = 0; i < scan->count; i++) {
+    tracked = (tracked_t*)g_hash_table_lookup(
+        walk->tracked, GINT_TO_POINTER(scan->top[i].pid));
+    if(!tracked->name[0]) {
+      g_snprintf(pid, sizeof(pid), "%d", tracked->pid);
+      if(scan_read(dirfd(walk->dir), pid, "comm", tracked->name,
+                   sizeof(tracked->name)) <= 0)
+        g_strlcpy(tracked->name, pid, sizeof(tracked->name));
+      if((p = strchr(tracked->name, '\n')))
+        *p = '\0';
+    }
+    g_strlcpy(scan->top[i].name, tracked->name, sizeof(scan->top[i].name));
+  }
+
+  closedir(walk->dir);
+  walk->dir  = NULL;
+  walk->done = TRUE;
+}
+
+/* Looks at the next app.scanner.slice entries of /proc, so that a scan of
+   thousands of processes is spread out instead of done in one go */
+static void walk_slice(walk_t* walk) {
+  struct dirent* ent = NULL;
+  guint          i   = 0;
+
+  if(!walk->dir) {
+    if(!(walk->dir = opendir(app.scanner.proc))) {
+      walk->top.count = 0;
+      walk->done      = TRUE;
+      return;
+    }
+    walk->scan++;
+    walk->top.count = 0;
+  }
+
+  walk->done = FALSE;
+  for(i = 0; i < app.scanner.slice; i++) {
+    if(!(ent = readdir(walk->dir))) {
+      walk_finish(walk);
+      return;
+    }
+    if(ent->d_name[0] >= '1' && ent->d_name[0] <= '9')
+      walk_visit(walk, ent->d_name);
+  }
+}
+
+/* This runs on a worker thread */
+static void scanner_thread(GTask*        task,
+                           gpointer      source,
+                           gpointer      data,
+                           GCancellable* cancellable) {
+  walk_slice((walk_t*)data);
+  g_task_return_boolean(task, TRUE);
+}
+
+/* Runs the next slice of the scan in progress, or starts a new scan */
+static void scanner_slice() {
+  GTask* task = NULL;
+
+  if(!scanner.walk)
+    scanner.walk = walk_new();
+  task = g_task_new(NULL, NULL, cb_scanner_done, NULL);
+  g_task_set_task_data(task, scanner.walk, NULL);
+  g_task_run_in_thread(task, scanner_thread);
+  scanner.task = task;
+  g_object_unref(G_OBJECT(task));
+}
+
+/* Nothing is done if a scan is already in progress */
+static void scanner_start() {
+  if(!scanner.task && !scanner.pause)
+    scanner_slice();
+}
+
+/* If the scanner was released while a slice was running, the walk was left
+   to it and is deleted now. Otherwise, the scan goes on with the next slice
+   after a pause, or its result is used if it is complete */
+static void scanner_done(GTask* task) {
+  walk_t* walk = (walk_t*)g_task_get_task_data(task);
+
+  if(task != scanner.task) {
+    walk_delete(walk);
+    return;
+  }
+
+  scanner.task = NULL;
+  if(!walk->done) {
+    scanner.pause = g_timeout_add(app.scanner.pause, cb_scanner_pause, NULL);
+    return;
+  }
+  scanner.scan = walk->top;
+  scanner.scans++;
+  scanner.time = g_get_monotonic_time();
+  if(scanner.tooltip)
+    gtk_tooltip_trigger_tooltip_query(gdk_display_get_default());
+  scanner.tooltip = FALSE;
+}
+
+/* Called when a tooltip showing the scan is about to be shown. If the last
+   scan is stale, a new one is started and the tooltip is refreshed when it
+   completes */
+static void scanner_request() {
+  gint64 now = g_get_monotonic_time();
+  gint64 age = now - scanner.time;
+
+  scanner.requested = now;
+  if(!scanner.timer)
+    scanner.timer = g_timeout_add_seconds(app.scanner.period / 1000,
+                                          cb_scanner_timer_tick, NULL);
+  if(!scanner.time || age > (gint64)app.scanner.fresh * 1000) {
+    scanner.tooltip = TRUE;
+    scanner_start();
+  }
+}
+
+/* The background scans stop once the tooltips have not been looked at for a
+   while. The next request starts them again */
+static gboolean scanner_timer_tick() {
+  gint64 idle = g_get_monotonic_time() - scanner.requested;
+
+  if(idle > (gint64)app.scanner.idle * 1000) {
+    scanner.timer = 0;
+    return FALSE;
+  }
+  scanner_start();
   return TRUE;
 }
 
+static void scanner_ref() {
+  scanner.refs++;
+}
+
+/* A slice that is still running keeps the walk, and deletes it when it is
+   done */
+static void scanner_unref() {
+  if(--scanner.refs)
+    return;
+
+  if(scanner.timer)
+    g_source_remove(scanner.timer);
+  if(scanner.pause)
+    g_source_remove(scanner.pause);
+  if(scanner.walk && !scanner.task)
+    walk_delete(scanner.walk);
+  memset(&scanner, 0, sizeof(scanner_t));
+}
+
+/* The processes using the most memory, as of the last scan */
+static void monitor_gen_tooltip_processes(tooltip_t* tooltip) {
+  const process_t* process = NULL;
+  guint            i       = 0;
+
+  if(scanner.scan.count)
+    tooltip_append(tooltip, "\n");
+  for(i = 0; i < scanner.scan.count; i++) {
+    process = &scanner.scan.top[i];
+    tooltip_append_escaped(tooltip, process->name, format_app.tooltip.width,
+                           TRUE);
+    tooltip_append_bytes(tooltip, process->rss);
+  }
+}
+
+/* The markup is only formatted again if there has been a new sample, or a
+   new scan for the monitors that show the processes */
+static gboolean monitor_gen_tooltip(monitor_t* monitor, GtkTooltip* tooltip) {
+  const spec_t*    s      = &spec[monitor->id];
+  tooltip_t*       cache  = &monitor->tooltip;
+  GdkPixbuf*       icon   = pixbufs_get_tooltip(monitor->pixbufs, monitor->id);
+  gint64           start  = probe_now();
+  tooltip_source_t source = {monitor->id, &monitor->stats, &monitor->trend,
+                             monitor->opts.cgroup};
+
+  if(s->processes)
+    scanner_request();
+
+  if(!cache->valid || (s->processes && cache->scans != scanner.scans)) {
+    tooltip_clear(cache);
+    tooltip_open_tag(cache, "<span><tt>", "</tt></span>");
+    s->gen_tooltip(cache, &source);
+    if(s->processes)
+      monitor_gen_tooltip_processes(cache);
+    /* Every row ends with a newline, but the last one does not need it */
+    if(cache->len && cache->buf[cache->len - 1] == '\n')
+      cache->buf[--cache->len] = '\0';
+    tooltip_close_tag(cache, "</tt></span>");
+    cache->valid = TRUE;
+    cache->scans = scanner.scans;
+  }
+
+  gtk_tooltip_set_icon(tooltip, icon);
+  gtk_tooltip_set_markup(tooltip, cache->buf);
+  probe_record(PROBE_TOOLTIP, start);
+
+  return TRUE;
+}
+
+/* The thresholds take precedence over the trend, which only colours the
+   dial if it predicts that the monitor will run out within the horizon. A
+   monitor of a rate never runs out so it has no trend */
+static const gdouble* monitor_get_colour(monitor_t* monitor) {
+  gdouble eta = trend_get_exhaustion(&monitor->trend, monitor->stats.total);
+
+  if(monitor->level != LEVEL_NORMAL)
+    return app.alert.colours[monitor->level];
+  if(stats_spec[monitor->id].ceiling)
+    return NULL;
+  if(eta >= 0 && eta < app.trend.horizon)
+    return app.trend.colour;
+  return NULL;
+}
+
+/* Identifies what the dial looks like so that it is only drawn again when
+   it changes. A split dial has a ring for each node and each of them takes
+   a byte */
+static guint64 monitor_get_index(monitor_t* monitor) {
+  stats_t*      stats = &monitor->stats;
+  stats_numa_t* numa  = &stats->numa;
+  guint64       index = 0;
+  guint         i     = 0;
+
+  if(monitor->opts.themed && !monitor_get_colour(monitor))
+    return get_pixbuf_index(stats->total, stats->available);
+  if(spec[monitor->id].split && numa->count > 1) {
+    for(i = 0; i < numa->count; i++)
+      index = (index << 8) |
+              get_percent(numa->nodes[i].total, numa->nodes[i].free);
+    return index;
+  }
+  return get_percent(stats->total, stats->available);
+}
+
+/* While the dial does not move, the period is doubled up to the ceiling. As
+   soon as it moves, it drops back to the configured period. Neither applies
+   during a burst. Once a burst ends, the period is doubled back up to the
+   configured one */
+static void monitor_adapt_period(monitor_t* monitor) {
+  opts_t*       opts   = &monitor->opts;
+  subscriber_t* sub    = &monitor->sub;
+  guint64       index  = monitor_get_index(monitor);
+  guint         period = monitor_get_period(monitor);
+
+  if(g_get_monotonic_time() < monitor->burst)
+    sub->period = app.burst.period;
+  else if(sub->period < period)
+    sub->period = MIN(sub->period * 2, period);
+  else if(opts->adaptive && index == monitor->index)
+    sub->period = MIN(sub->period * 2, MAX(opts->ceiling, period));
+  else
+    sub->period = period;
+  monitor->index = index;
+}
+
+/* This runs on the sampler thread. Nothing but the sampler thread touches
+   the reading while a read of it is pending */
+static gboolean reading_read(reading_t* reading, const meminfo_t* meminfo) {
+  return stats_read(reading->id, &reading->files, &reading->stats, meminfo);
+}
+
+/* This may run on the sampler thread if the monitor was deleted while the
+   reading was being read */
+static void reading_delete(reading_t* reading) {
+  if(reading->open && stats_spec[reading->id].close)
+    stats_spec[reading->id].close(&reading->files);
+  g_free(reading);
+}
+
+/* The sample is only copied to where the rest of the plugin looks for the
+   stats once it has come back from the sampler thread. The thresholds are
+   only checked here, so that nothing but a new sample can cross them */
+static void monitor_sample(monitor_t* monitor, gboolean ok, gint64 time) {
+  stats_t* stats = &monitor->stats;
+  gui_t*   gui   = &monitor->gui;
+  guint32  value = 0;
+
+  /* The sample is of the cgroup that has just been replaced */
+  if(monitor->reopen)
+    ok = FALSE;
+  monitor_sync(monitor);
+  if(ok) {
+    *stats                 = monitor->reading->stats;
+    monitor->tooltip.valid = FALSE;
+    value = get_value(stats->total, stats->available);
+    trend_push(&monitor->trend, time,
+               stats->total - MIN(stats->available, stats->total));
+    history_push(&monitor->history, value);
+    if(monitor->graph.surface) {
+      graph_push(&monitor->graph, value);
+      gtk_widget_queue_draw(gui->graph);
+    }
+    monitor_adapt_period(monitor);
+    monitor_update_level(monitor,
+                         get_percent(stats->total, stats->available));
+    monitor_update_gui(monitor);
+  }
+}
+
 static void monitor_update_timer(monitor_t* monitor) {
-  opts_t* opts = &(monitor->opts);
+  opts_t*       opts = &monitor->opts;
+  subscriber_t* sub  = &monitor->sub;
 
+  monitor_sync(monitor);
   if(opts->enable) {
-    if(monitor->timer) {
-      g_source_remove(monitor->timer);
-      monitor->timer = 0;
-    }
-    monitor_timer_tick(monitor);
+    sub->period   = monitor_get_period(monitor);
+    sub->pressure = opts->pressure;
+    sampler_subscribe(sub);
+  } else {
+    sampler_unsubscribe(sub);
   }
 }
 
-static void monitor_update_gui(monitor_t* monitor) {
-  guint      index   = 0;
-  stats_t*   stats   = &monitor->stats;
-  gui_t*     gui     = &monitor->gui;
-  opts_t*    opts    = &monitor->opts;
-  pixbufs_t* pixbufs = monitor->pixbufs;
+static guint monitor_get_period(monitor_t* monitor) {
+  return monitor->period ? monitor->period : monitor->opts.period;
+}
+
+/* The period (ms) set over the bus is only in effect until the plugin exits
+   or the period is changed in the dialog, so it is kept apart from the
+   options that are saved. 0 goes back to the configured period */
+static void monitor_set_period(monitor_t* monitor, guint period) {
+  monitor->period = period;
+  monitor_update_timer(monitor);
+}
+
+/* Samples the monitor at app.burst.period for the duration (ms). It goes
+   back to its own period on the first sample after the burst has ended */
+static void monitor_burst(monitor_t* monitor, guint duration) {
+  subscriber_t* sub = &monitor->sub;
+
+  if(!monitor->opts.enable)
+    return;
+
+  monitor->burst = g_get_monotonic_time() + (gint64)duration * 1000;
+  sub->period    = app.burst.period;
+  sampler_subscribe(sub);
+}
+
+/* A threshold is crossed as soon as the percentage used reaches it but it
+   is only cleared once the percentage has dropped app.alert.hysteresis
+   below it, so that a monitor hovering around a threshold does not flap */
+static guint monitor_get_level(monitor_t* monitor, guint percent) {
+  opts_t* opts               = &monitor->opts;
+  guint   thresholds[LEVELS] = {0, opts->warning, opts->critical};
+  guint   level              = monitor->level;
+
+  while(level < LEVEL_CRITICAL && percent >= thresholds[level + 1])
+    level++;
+  while(level > LEVEL_NORMAL &&
+        percent + app.alert.hysteresis < thresholds[level])
+    level--;
+
+  return level;
+}
+
+/* A monitor of a rate is not running out of anything, so it says how fast
+   things are happening instead */
+static void monitor_notify(monitor_t* monitor, guint percent) {
+  const gchar* name    = stats_spec[monitor->id].name;
+  stats_t*     stats   = &monitor->stats;
+  const gchar* summary = app.alert.summaries[monitor->level];
+  gchar*       body    = NULL;
+
+  if(stats_spec[monitor->id].ceiling) {
+    summary = app.alert.rates[monitor->level];
+    body    = g_strdup_printf("%s is at %lu events/s, %u%% of the maximum",
+                              name, stats->total - stats->available, percent);
+  } else {
+    body = g_strdup_printf("%s is %u%% used", name, percent);
+  }
+  bus_notify(pixbufs_spec[monitor->id].icon, summary, body,
+             monitor->level == LEVEL_CRITICAL ? 2 : 1);
+  g_free(body);
+}
+
+/* Crossing a threshold upwards samples the monitor quickly for a while so
+   that it is caught before it runs out */
+static void monitor_update_level(monitor_t* monitor, guint percent) {
+  guint    level   = monitor_get_level(monitor, percent);
+  gboolean crossed = level > monitor->level;
+
+  monitor->level = level;
+  if(crossed) {
+    monitor_burst(monitor, app.alert.burst);
+    if(monitor->opts.notify)
+      monitor_notify(monitor, percent);
+  }
+}
+
+static void monitor_invalidate(monitor_t* monitor) {
+  monitor->render.valid = FALSE;
+}
 
-  if(spec[monitor->id].stats_read(stats)) {
-    index = get_pixbuf_index(stats->total, stats->available);
-    if(opts->enable) {
+/* Only the parts of the GUI that differ from what was last rendered are
+   updated. In the steady state, this does not touch GTK at all */
+static void monitor_update_gui(monitor_t* monitor) {
+  guint          percent = 0;
+  guint64        index   = 0;
+  const gdouble* colour  = NULL;
+  GdkPixbuf*     dial    = NULL;
+  stats_t*       stats   = &monitor->stats;
+  gui_t*         gui     = &monitor->gui;
+  opts_t*        opts    = &monitor->opts;
+  render_t*      render  = &monitor->render;
+  pixbufs_t*     pixbufs = monitor->pixbufs;
+  guint          size    = pixbufs->size_dial;
+  gboolean       force   = !render->valid;
+  gboolean       graph   = opts->display != DISPLAY_DIAL;
+  gint64         start   = probe_now();
+
+  /* The drawn dial has a resolution of 1%, the themed icons only of 5%. The
+     themed icons cannot be recoloured so the dial is drawn instead while it
+     needs attention */
+  percent = get_percent(stats->total, stats->available);
+  index   = monitor_get_index(monitor);
+  colour  = monitor_get_colour(monitor);
+  if(opts->enable) {
+    /* While the icons are being loaded, the icon is left empty but keeps its
+       size and the dial is drawn instead of using the themed one */
+    if(force) {
+      gtk_widget_set_size_request(gui->img_icon, pixbufs->size_dial,
+                                  pixbufs->size_dial);
       gtk_image_set_from_pixbuf(GTK_IMAGE(gui->img_icon),
                                 pixbufs->icons[monitor->id]);
-      gtk_image_set_from_pixbuf(GTK_IMAGE(gui->img_dial),
-                                pixbufs->dials[index]);
+    }
+    if(force || render->index != index || render->colour != colour) {
+      if(opts->themed && !pixbufs->pending && !colour) {
+        gtk_image_set_from_pixbuf(GTK_IMAGE(gui->img_dial),
+                                  pixbufs->dials[index]);
+      } else {
+        if(spec[monitor->id].split && stats->numa.count > 1)
+          dial = dial_render_split(size, &stats->numa, opts->ramp, colour);
+        else
+          dial = dial_render(size, percent, opts->ramp, colour);
+        gtk_image_set_from_pixbuf(GTK_IMAGE(gui->img_dial), dial);
+        if(dial)
+          g_object_unref(G_OBJECT(dial));
+      }
+    }
+    if(force || render->border != opts->border)
       gtk_container_set_border_width(GTK_CONTAINER(gui->grid), opts->border);
+    if(force || render->padding != opts->padding) {
       gtk_grid_set_row_spacing(GTK_GRID(gui->grid), opts->padding);
       gtk_grid_set_column_spacing(GTK_GRID(gui->grid), opts->padding);
-      gtk_widget_show(gui->grid);
+    }
+    if(force || render->icon != opts->icon) {
       if(opts->icon)
         gtk_widget_show(gui->img_icon);
       else
         gtk_widget_hide(gui->img_icon);
-    } else {
-      gtk_widget_hide(gui->grid);
     }
+    if(force || render->display != opts->display) {
+      gtk_widget_set_visible(gui->img_dial, opts->display != DISPLAY_GRAPH);
+      gtk_widget_set_visible(gui->graph, graph);
+    }
+    /* The graph is only redrawn completely when it is invalidated. Otherwise
+       it is updated incrementally as samples are added */
+    if(force) {
+      if(graph) {
+        gtk_widget_set_size_request(gui->graph, size * 2, size);
+        graph_resize(&monitor->graph, size * 2, size, opts->ramp,
+                     &monitor->history);
+      } else {
+        graph_delete(&monitor->graph);
+      }
+      gtk_widget_queue_draw(gui->graph);
+    }
+    if(!render->shown)
+      gtk_widget_show(gui->grid);
+
+    render->valid   = TRUE;
+    render->shown   = TRUE;
+    render->icon    = opts->icon;
+    render->index   = index;
+    render->colour  = colour;
+    render->border  = opts->border;
+    render->padding = opts->padding;
+    render->display = opts->display;
+  } else if(render->shown) {
+    gtk_widget_hide(gui->grid);
+    render->shown = FALSE;
   }
+  probe_record(PROBE_GUI, start);
 }
 
 static void monitor_construct(monitor_t* monitor, guint id, plugin_t* plugin) {
-  GtkWidget *      grid, *img_icon, *img_dial;
+  GtkWidget *      grid, *img_icon, *img_dial, *graph;
   GtkOrientation   orientation;
   XfcePanelPlugin* xfce    = plugin->xfce;
   gui_t*           gui     = &monitor->gui;
   opts_t*          opts    = &monitor->opts;
   pixbufs_t*       pixbufs = &plugin->pixbufs;
 
-  orientation      = xfce_panel_plugin_get_orientation(xfce);
-  monitor->id      = id;
-  monitor->timer   = 0;
-  monitor->pixbufs = pixbufs;
+  orientation                   = xfce_panel_plugin_get_orientation(xfce);
+  monitor->id                   = id;
+  monitor->pixbufs              = pixbufs;
+  monitor->file                 = get_history_file(xfce, id);
+  monitor->reading              = g_new0(reading_t, 1);
+  monitor->reading->id          = id;
+  monitor->reading->job.read    = cb_reading_read;
+  monitor->reading->job.release = cb_reading_release;
+  monitor->reading->job.data    = monitor->reading;
+  monitor->sub.job              = &monitor->reading->job;
+  monitor->sub.notify           = cb_monitor_sample;
+  monitor->sub.data             = monitor;
 
   grid = gtk_grid_new();
   gtk_grid_set_row_spacing(GTK_GRID(grid), opts->padding);
@@ -529,18 +2658,115 @@ static void monitor_construct(monitor_t* monitor, guint id, plugin_t* plugin) {
   gtk_grid_attach(GTK_GRID(grid), img_dial, 0, 1, 1, 1);
   gtk_widget_show(img_dial);
 
+  graph = gtk_drawing_area_new();
+  gtk_widget_set_halign(graph, GTK_ALIGN_CENTER);
+  gtk_widget_set_valign(graph, GTK_ALIGN_CENTER);
+  gtk_grid_attach(GTK_GRID(grid), graph, 1, 1, 1, 1);
+
   gui->grid     = grid;
   gui->img_icon = img_icon;
   gui->img_dial = img_dial;
+  gui->graph    = graph;
+
+  if(!opts->cgroup)
+    opts->cgroup = g_strdup(app.defaults.cgroup);
+  if(!opts->rate)
+    opts->rate = app.defaults.rate;
+  if(!opts->warning)
+    opts->warning = app.defaults.warning;
+  if(!opts->critical)
+    opts->critical = app.defaults.critical;
+  monitor_sync(monitor);
+
+  monitor->render.valid = FALSE;
+  monitor->render.shown = TRUE;
 
   g_object_set(G_OBJECT(gui->grid), "has-tooltip", TRUE, NULL);
   g_signal_connect(G_OBJECT(gui->grid), "query-tooltip",
                    G_CALLBACK(cb_monitor_gen_tooltip), monitor);
+  g_signal_connect(G_OBJECT(gui->graph), "draw",
+                   G_CALLBACK(cb_monitor_draw_graph), monitor);
+}
+
+static void monitor_draw_graph(monitor_t* monitor, cairo_t* cr) {
+  graph_t* graph = &monitor->graph;
+
+  if(graph->surface) {
+    cairo_set_source_surface(cr, graph->surface, 0, 0);
+    cairo_paint(cr);
+  }
+}
+
+/* Nothing is kept open for a monitor that is disabled. The files of a
+   monitor belong to the sampler thread while a read of them is pending, so
+   any change to them is held back until it has come back. The history is
+   only ever touched on the main thread */
+static void monitor_sync(monitor_t* monitor) {
+  const stats_spec_t* s       = &stats_spec[monitor->id];
+  reading_t*          reading = monitor->reading;
+  history_t*          history = &monitor->history;
+  gboolean            enable  = monitor->opts.enable;
+
+  /* The stats that are drawn are never touched by the sampler thread */
+  if(s->ceiling)
+    s->ceiling(&monitor->stats, monitor->opts.rate);
+  if(enable && !history->header)
+    history_init(history, monitor->file);
+  else if(!enable && history->header)
+    history_delete(history);
+  if(monitor->sub.pending)
+    return;
+
+  if(reading->open && (!enable || monitor->reopen)) {
+    if(s->close)
+      s->close(&reading->files);
+    reading->open = FALSE;
+  }
+  if(!reading->open && enable) {
+    if(s->open)
+      s->open(&reading->files, monitor->opts.cgroup);
+    reading->open = TRUE;
+  }
+  /* A cgroup that is changed while the monitor is disabled is switched to
+     once it is enabled again */
+  if(monitor->reopen && enable) {
+    history_reset(history);
+    trend_reset(&monitor->trend);
+    monitor_invalidate(monitor);
+    monitor->tooltip.valid = FALSE;
+    monitor->reopen        = FALSE;
+  }
+  if(s->ceiling)
+    s->ceiling(&monitor->reading->stats, monitor->opts.rate);
 }
 
+/* Switches a cgroup monitor to a different cgroup. The history of the old
+   one is of no use any more */
+static void monitor_reopen(monitor_t* monitor) {
+  monitor->reopen = TRUE;
+  monitor_sync(monitor);
+}
+
+/* Does nothing if the cgroup has not changed so that the history is only
+   lost when it has to be */
+static void monitor_set_cgroup(monitor_t* monitor, const gchar* cgroup) {
+  if(!g_strcmp0(monitor->opts.cgroup, cgroup))
+    return;
+
+  opts_cgroup_changed(&monitor->opts, cgroup);
+  monitor_reopen(monitor);
+  monitor_update_gui(monitor);
+}
+
+/* The reading is handed over to the sampler, which closes its files once any
+   read of it that is in flight has come back */
 static void monitor_delete(monitor_t* monitor) {
-  if(monitor->timer)
-    g_source_remove(monitor->timer);
+  sampler_drop(&monitor->sub);
+  monitor->reading = NULL;
+  graph_delete(&monitor->graph);
+  history_delete(&monitor->history);
+  g_free(monitor->file);
+  g_free(monitor->opts.cgroup);
 }
 
 static void opts_enable_toggled(opts_t* opts, gboolean enabled) {
@@ -563,14 +2789,79 @@ static void opts_padding_changed(opts_t* opts, guint padding) {
   opts->padding = padding;
 }
 
+static void opts_themed_toggled(opts_t* opts, gboolean themed) {
+  opts->themed = themed;
+}
+
+static void opts_ramp_toggled(opts_t* opts, gboolean ramp) {
+  opts->ramp = ramp;
+}
+
+static void opts_pressure_toggled(opts_t* opts, gboolean pressure) {
+  opts->pressure = pressure;
+}
+
+static void opts_adaptive_toggled(opts_t* opts, gboolean adaptive) {
+  opts->adaptive = adaptive;
+}
+
+static void opts_ceiling_changed(opts_t* opts, double ceiling) {
+  opts->ceiling = ceiling * 1000;
+}
+
+static void opts_display_changed(opts_t* opts, guint display) {
+  opts->display = display;
+}
+
+static void opts_cgroup_changed(opts_t* opts, const gchar* cgroup) {
+  g_free(opts->cgroup);
+  opts->cgroup = g_strdup(cgroup);
+}
+
+static void opts_warning_changed(opts_t* opts, guint warning) {
+  opts->warning = warning;
+}
+
+static void opts_critical_changed(opts_t* opts, guint critical) {
+  opts->critical = critical;
+}
+
+/* The thresholds may have been edited by hand. The warning is lowered if it
+   is above the critical threshold so that the critical one is never missed */
+static void opts_thresholds_check(opts_t* opts) {
+  const range_t* range = &app.config.threshold;
+
+  opts->warning  = CLAMP(opts->warning, (guint)range->min, (guint)range->max);
+  opts->critical = CLAMP(opts->critical, (guint)range->min, (guint)range->max);
+  opts->warning  = MIN(opts->warning, opts->critical);
+}
+
+static void opts_notify_toggled(opts_t* opts, gboolean notify) {
+  opts->notify = notify;
+}
+
+static void opts_rate_changed(opts_t* opts, guint rate) {
+  opts->rate = rate;
+}
+
 static void config_dialog_update_gui(config_t* config, gboolean enabled) {
   gtk_widget_set_sensitive(config->grid, enabled);
 }
 
 static void
 config_dialog_response(plugin_t* plugin, GtkWidget* dialog, int response) {
-  XfcePanelPlugin* xfce = plugin->xfce;
+  XfcePanelPlugin* xfce   = plugin->xfce;
+  config_t*        config = NULL;
+  guint            i      = 0;
 
+  /* A cgroup that was typed in but never confirmed */
+  for(i = 0; i < app.monitors; i++) {
+    config = &plugin->monitors[i].config;
+    if(config->txt_cgroup)
+      monitor_set_cgroup(&plugin->monitors[i],
+                         gtk_entry_get_text(GTK_ENTRY(config->txt_cgroup)));
+    config->txt_cgroup = NULL;
+  }
   gtk_widget_destroy(dialog);
   xfce_panel_plugin_unblock_menu(xfce);
   plugin_opts_write(plugin);
@@ -581,6 +2872,8 @@ static void config_dialog_add_appearance(plugin_t*  plugin,
                                          GtkWidget* notebook) {
   GtkWidget *lbl_border, *lbl_padding;
   GtkWidget *spin_border, *spin_padding;
+  GtkWidget *chk_themed, *chk_ramp, *chk_pressure;
+  GtkWidget *lbl_display, *cmb_display;
   GtkWidget *grid, *frm, *lbl_title;
   monitor_t* monitor = &plugin->monitors[RAM];
   opts_t*    opts    = &monitor->opts;
@@ -622,6 +2915,51 @@ static void config_dialog_add_appearance(plugin_t*  plugin,
   gtk_grid_attach(GTK_GRID(grid), spin_padding, 1, 1, 1, 1);
   gtk_widget_show(spin_padding);
 
+  chk_themed = gtk_check_button_new_with_mnemonic("Use themed dial icons");
+  gtk_widget_set_tooltip_text(chk_themed,
+                              "Use the dial icons from the icon theme instead "
+                              "of drawing the dial");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(chk_themed), opts->themed);
+  gtk_grid_attach(GTK_GRID(grid), chk_themed, 0, 2, 2, 1);
+  gtk_widget_show(chk_themed);
+
+  chk_ramp = gtk_check_button_new_with_mnemonic("Colour dial by usage");
+  gtk_widget_set_tooltip_text(chk_ramp,
+                              "Colour the drawn dial from green to red as "
+                              "usage increases");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(chk_ramp), opts->ramp);
+  gtk_widget_set_sensitive(chk_ramp, !opts->themed);
+  gtk_grid_attach(GTK_GRID(grid), chk_ramp, 0, 3, 2, 1);
+  gtk_widget_show(chk_ramp);
+
+  chk_pressure =
+      gtk_check_button_new_with_mnemonic("Update on memory pressure");
+  gtk_widget_set_tooltip_text(chk_pressure,
+                              "Update as soon as the kernel reports memory "
+                              "pressure and poll slowly otherwise");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(chk_pressure),
+                               opts->pressure);
+  gtk_grid_attach(GTK_GRID(grid), chk_pressure, 0, 4, 2, 1);
+  gtk_widget_show(chk_pressure);
+
+  lbl_display = gtk_label_new("Display");
+  gtk_label_set_width_chars(GTK_LABEL(lbl_display), app.config.display.width);
+  gtk_widget_set_tooltip_text(lbl_display, "What to show for each monitor");
+  gtk_misc_set_padding(GTK_MISC(lbl_display), app.config.display.padding,
+                       app.config.display.padding);
+  gtk_grid_attach(GTK_GRID(grid), lbl_display, 0, 5, 1, 1);
+  gtk_widget_show(lbl_display);
+
+  /* These must be in the same order as the DISPLAY_* constants */
+  cmb_display = gtk_combo_box_text_new();
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cmb_display), "Dial");
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cmb_display), "Graph");
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cmb_display),
+                                 "Dial and graph");
+  gtk_combo_box_set_active(GTK_COMBO_BOX(cmb_display), opts->display);
+  gtk_grid_attach(GTK_GRID(grid), cmb_display, 1, 5, 1, 1);
+  gtk_widget_show(cmb_display);
+
   frm = gtk_frame_new(NULL);
   gtk_container_set_border_width(GTK_CONTAINER(frm), app.config.display.border);
   gtk_container_add(GTK_CONTAINER(frm), grid);
@@ -635,12 +2973,27 @@ static void config_dialog_add_appearance(plugin_t*  plugin,
                    G_CALLBACK(cb_config_border_changed), plugin);
   g_signal_connect(spin_padding, "value_changed",
                    G_CALLBACK(cb_config_padding_changed), plugin);
+  g_signal_connect(chk_themed, "toggled", G_CALLBACK(cb_config_themed_toggled),
+                   plugin);
+  g_signal_connect(chk_ramp, "toggled", G_CALLBACK(cb_config_ramp_toggled),
+                   plugin);
+  g_signal_connect(chk_pressure, "toggled",
+                   G_CALLBACK(cb_config_pressure_toggled), plugin);
+  g_signal_connect(cmb_display, "changed",
+                   G_CALLBACK(cb_config_display_changed), plugin);
+
+  g_object_set_data(G_OBJECT(chk_themed), "ramp", chk_ramp);
 }
 
 static void config_dialog_add_monitor(monitor_t* monitor, GtkWidget* notebook) {
   GtkWidget* evt_enable;
-  GtkWidget *chk_enable, *chk_icon;
+  GtkWidget *chk_enable, *chk_icon, *chk_adaptive;
   GtkWidget *lbl_period, *spin_period;
+  GtkWidget *lbl_ceiling, *spin_ceiling;
+  GtkWidget *lbl_warning, *spin_warning;
+  GtkWidget *lbl_critical, *spin_critical, *chk_notify;
+  GtkWidget *lbl_cgroup, *txt_cgroup;
+  GtkWidget *lbl_rate, *spin_rate;
   GtkWidget *grid, *frm, *lbl_title;
   config_t*  config = &monitor->config;
   opts_t*    opts   = &monitor->opts;
@@ -674,6 +3027,119 @@ static void config_dialog_add_monitor(monitor_t* monitor, GtkWidget* notebook) {
   gtk_grid_attach(GTK_GRID(grid), spin_period, 1, 1, 1, 1);
   gtk_widget_show(spin_period);
 
+  chk_adaptive = gtk_check_button_new_with_mnemonic("Adapt period to usage");
+  gtk_widget_set_tooltip_text(chk_adaptive,
+                              "Update less often while the dial does not move");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(chk_adaptive),
+                               opts->adaptive);
+  gtk_grid_attach(GTK_GRID(grid), chk_adaptive, 0, 2, 2, 1);
+  gtk_widget_show(chk_adaptive);
+
+  lbl_ceiling = gtk_label_new("Max period (s)");
+  gtk_label_set_width_chars(GTK_LABEL(lbl_ceiling), app.config.display.width);
+  gtk_misc_set_padding(GTK_MISC(lbl_ceiling), app.config.display.padding,
+                       app.config.display.padding);
+  gtk_widget_set_tooltip_text(lbl_ceiling,
+                              "Slowest update frequency when adapting");
+  gtk_grid_attach(GTK_GRID(grid), lbl_ceiling, 0, 3, 1, 1);
+  gtk_widget_show(lbl_ceiling);
+
+  spin_ceiling = gtk_spin_button_new_with_range(
+      app.config.ceiling.min, app.config.ceiling.max, app.config.ceiling.step);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_ceiling),
+                            opts->ceiling / 1000);
+  gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_ceiling), TRUE);
+  gtk_widget_set_sensitive(spin_ceiling, opts->adaptive);
+  gtk_grid_attach(GTK_GRID(grid), spin_ceiling, 1, 3, 1, 1);
+  gtk_widget_show(spin_ceiling);
+
+  lbl_warning = gtk_label_new("Warning (%)");
+  gtk_label_set_width_chars(GTK_LABEL(lbl_warning), app.config.display.width);
+  gtk_misc_set_padding(GTK_MISC(lbl_warning), app.config.display.padding,
+                       app.config.display.padding);
+  gtk_widget_set_tooltip_text(lbl_warning,
+                              "Recolour the dial and update quickly for a "
+                              "while at this percentage used");
+  gtk_grid_attach(GTK_GRID(grid), lbl_warning, 0, 4, 1, 1);
+  gtk_widget_show(lbl_warning);
+
+  spin_warning = gtk_spin_button_new_with_range(app.config.threshold.min,
+                                                app.config.threshold.max,
+                                                app.config.threshold.step);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_warning), opts->warning);
+  gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_warning), TRUE);
+  gtk_grid_attach(GTK_GRID(grid), spin_warning, 1, 4, 1, 1);
+  gtk_widget_show(spin_warning);
+
+  lbl_critical = gtk_label_new("Critical (%)");
+  gtk_label_set_width_chars(GTK_LABEL(lbl_critical),
+                            app.config.display.width);
+  gtk_misc_set_padding(GTK_MISC(lbl_critical), app.config.display.padding,
+                       app.config.display.padding);
+  gtk_widget_set_tooltip_text(lbl_critical,
+                              "Like the warning, but more urgent");
+  gtk_grid_attach(GTK_GRID(grid), lbl_critical, 0, 5, 1, 1);
+  gtk_widget_show(lbl_critical);
+
+  spin_critical = gtk_spin_button_new_with_range(app.config.threshold.min,
+                                                 app.config.threshold.max,
+                                                 app.config.threshold.step);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_critical), opts->critical);
+  gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_critical), TRUE);
+  gtk_grid_attach(GTK_GRID(grid), spin_critical, 1, 5, 1, 1);
+  gtk_widget_show(spin_critical);
+
+  chk_notify = gtk_check_button_new_with_mnemonic("Notify when crossed");
+  gtk_widget_set_tooltip_text(
+      chk_notify, "Send a desktop notification when a threshold is crossed");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(chk_notify), opts->notify);
+  gtk_grid_attach(GTK_GRID(grid), chk_notify, 0, 6, 2, 1);
+  gtk_widget_show(chk_notify);
+
+  if(stats_spec[i].path) {
+    lbl_cgroup = gtk_label_new(spec[i].config.cgroup.label);
+    gtk_label_set_width_chars(GTK_LABEL(lbl_cgroup), app.config.display.width);
+    gtk_misc_set_padding(GTK_MISC(lbl_cgroup), app.config.display.padding,
+                         app.config.display.padding);
+    gtk_widget_set_tooltip_text(lbl_cgroup, spec[i].config.cgroup.tooltip);
+    gtk_grid_attach(GTK_GRID(grid), lbl_cgroup, 0, 7, 1, 1);
+    gtk_widget_show(lbl_cgroup);
+
+    txt_cgroup = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(txt_cgroup), opts->cgroup);
+    gtk_grid_attach(GTK_GRID(grid), txt_cgroup, 1, 7, 1, 1);
+    gtk_widget_show(txt_cgroup);
+
+    /* Not on every keystroke, since every intermediate path would be opened
+       and would wipe the history */
+    g_signal_connect(txt_cgroup, "activate",
+                     G_CALLBACK(cb_config_cgroup_changed), monitor);
+    g_signal_connect(txt_cgroup, "focus-out-event",
+                     G_CALLBACK(cb_config_cgroup_focus_out), monitor);
+    config->txt_cgroup = txt_cgroup;
+  }
+
+  if(stats_spec[i].ceiling) {
+    lbl_rate = gtk_label_new("Max rate (/s)");
+    gtk_label_set_width_chars(GTK_LABEL(lbl_rate), app.config.display.width);
+    gtk_misc_set_padding(GTK_MISC(lbl_rate), app.config.display.padding,
+                         app.config.display.padding);
+    gtk_widget_set_tooltip_text(lbl_rate,
+                                "Events per second at which the dial is full");
+    gtk_grid_attach(GTK_GRID(grid), lbl_rate, 0, 7, 1, 1);
+    gtk_widget_show(lbl_rate);
+
+    spin_rate = gtk_spin_button_new_with_range(
+        app.config.rate.min, app.config.rate.max, app.config.rate.step);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_rate), opts->rate);
+    gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_rate), TRUE);
+    gtk_grid_attach(GTK_GRID(grid), spin_rate, 1, 7, 1, 1);
+    gtk_widget_show(spin_rate);
+
+    g_signal_connect(spin_rate, "value_changed",
+                     G_CALLBACK(cb_config_rate_changed), monitor);
+  }
+
   evt_enable = gtk_event_box_new();
   gtk_widget_show(evt_enable);
 
@@ -691,13 +3157,16 @@ static void config_dialog_add_monitor(monitor_t* monitor, GtkWidget* notebook) {
   gtk_container_add(GTK_CONTAINER(frm), grid);
   gtk_widget_show(frm);
 
-  lbl_title = gtk_label_new(spec[i].name);
+  lbl_title = gtk_label_new(stats_spec[i].name);
   gtk_widget_show(lbl_title);
   gtk_notebook_append_page(GTK_NOTEBOOK(notebook), frm, lbl_title);
 
-  config->grid        = grid;
-  config->spin_period = spin_period;
-  config->chk_icon    = chk_icon;
+  config->grid          = grid;
+  config->spin_period   = spin_period;
+  config->spin_ceiling  = spin_ceiling;
+  config->spin_warning  = spin_warning;
+  config->spin_critical = spin_critical;
+  config->chk_icon      = chk_icon;
 
   g_signal_connect(chk_enable, "toggled", G_CALLBACK(cb_config_enable_toggled),
                    monitor);
@@ -705,6 +3174,54 @@ static void config_dialog_add_monitor(monitor_t* monitor, GtkWidget* notebook) {
                    monitor);
   g_signal_connect(spin_period, "value_changed",
                    G_CALLBACK(cb_config_period_changed), monitor);
+  g_signal_connect(chk_adaptive, "toggled",
+                   G_CALLBACK(cb_config_adaptive_toggled), monitor);
+  g_signal_connect(spin_ceiling, "value_changed",
+                   G_CALLBACK(cb_config_ceiling_changed), monitor);
+  g_signal_connect(spin_warning, "value_changed",
+                   G_CALLBACK(cb_config_warning_changed), monitor);
+  g_signal_connect(spin_critical, "value_changed",
+                   G_CALLBACK(cb_config_critical_changed), monitor);
+  g_signal_connect(chk_notify, "toggled", G_CALLBACK(cb_config_notify_toggled),
+                   monitor);
+}
+
+static void config_dialog_update_diagnostics(plugin_t* plugin) {
+  gchar* report = probe_report();
+  gchar* markup = g_markup_printf_escaped("<tt>%s</tt>", report);
+
+  gtk_label_set_markup(GTK_LABEL(plugin->diagnostics.label), markup);
+  g_free(markup);
+  g_free(report);
+}
+
+/* This tab is only added once it has been asked for with the "diagnostics"
+   remote event. It is refreshed for as long as the dialog is open */
+static void config_dialog_add_diagnostics(plugin_t*  plugin,
+                                          GtkWidget* notebook) {
+  diagnostics_t* diagnostics = &plugin->diagnostics;
+  GtkWidget *    frm, *lbl_title;
+
+  diagnostics->label = gtk_label_new(NULL);
+  gtk_label_set_selectable(GTK_LABEL(diagnostics->label), TRUE);
+  gtk_misc_set_padding(GTK_MISC(diagnostics->label),
+                       app.config.display.padding, app.config.display.padding);
+  gtk_widget_show(diagnostics->label);
+  config_dialog_update_diagnostics(plugin);
+
+  frm = gtk_frame_new(NULL);
+  gtk_container_set_border_width(GTK_CONTAINER(frm), app.config.display.border);
+  gtk_container_add(GTK_CONTAINER(frm), diagnostics->label);
+  gtk_widget_show(frm);
+
+  lbl_title = gtk_label_new("Diagnostics");
+  gtk_widget_show(lbl_title);
+  gtk_notebook_append_page(GTK_NOTEBOOK(notebook), frm, lbl_title);
+
+  diagnostics->timer =
+      g_timeout_add(app.probe.period, cb_config_diagnostics_tick, plugin);
+  g_signal_connect(diagnostics->label, "destroy",
+                   G_CALLBACK(cb_config_diagnostics_destroyed), plugin);
 }
 
 static void config_dialog_construct(plugin_t* plugin) {
@@ -717,7 +3234,7 @@ static void config_dialog_construct(plugin_t* plugin) {
   dialog = xfce_titled_dialog_new_with_buttons(
       "Configuration", GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(xfce))),
       GTK_DIALOG_DESTROY_WITH_PARENT, "gtk-close", GTK_RESPONSE_OK, NULL);
-  gtk_window_set_icon_name(GTK_WINDOW(dialog), spec[RAM].icon);
+  gtk_window_set_icon_name(GTK_WINDOW(dialog), pixbufs_spec[RAM].icon);
 
   g_signal_connect(dialog, "response", G_CALLBACK(cb_config_response), plugin);
 
@@ -731,6 +3248,8 @@ static void config_dialog_construct(plugin_t* plugin) {
   config_dialog_add_appearance(plugin, notebook);
   for(i = 0; i < app.monitors; i++)
     config_dialog_add_monitor(&plugin->monitors[i], notebook);
+  if(plugin->diagnostics.shown)
+    config_dialog_add_diagnostics(plugin, notebook);
   gtk_box_pack_start(GTK_BOX(box), notebook, TRUE, TRUE,
                      app.config.display.border);
   gtk_widget_show(notebook);
@@ -752,9 +3271,9 @@ static void plugin_opts_read(plugin_t* plugin) {
     if((rc = xfce_rc_simple_open(file, TRUE))) {
       for(i = 0; i < app.monitors; i++) {
         opts = &plugin->monitors[i].opts;
-        xfce_rc_set_group(rc, spec[i].name);
-        opts->enable =
-            xfce_rc_read_bool_entry(rc, app.rc.enable, app.defaults.enable);
+        xfce_rc_set_group(rc, stats_spec[i].name);
+        opts->enable = xfce_rc_read_bool_entry(
+            rc, app.rc.enable, app.defaults.enable && spec[i].enable);
         opts->icon =
             xfce_rc_read_bool_entry(rc, app.rc.icon, app.defaults.icon);
         opts->period =
@@ -763,6 +3282,32 @@ static void plugin_opts_read(plugin_t* plugin) {
             xfce_rc_read_int_entry(rc, app.rc.border, app.defaults.border);
         opts->padding =
             xfce_rc_read_int_entry(rc, app.rc.padding, app.defaults.padding);
+        opts->themed =
+            xfce_rc_read_bool_entry(rc, app.rc.themed, app.defaults.themed);
+        opts->ramp =
+            xfce_rc_read_bool_entry(rc, app.rc.ramp, app.defaults.ramp);
+        opts->pressure = xfce_rc_read_bool_entry(rc, app.rc.pressure,
+                                                 app.defaults.pressure);
+        opts->adaptive = xfce_rc_read_bool_entry(rc, app.rc.adaptive,
+                                                 app.defaults.adaptive);
+        opts->ceiling =
+            xfce_rc_read_int_entry(rc, app.rc.ceiling, app.defaults.ceiling);
+        opts->display = MIN((guint)xfce_rc_read_int_entry(
+                                rc, app.rc.display, app.defaults.display),
+                            DISPLAY_BOTH);
+        opts->warning =
+            xfce_rc_read_int_entry(rc, app.rc.warning, app.defaults.warning);
+        opts->critical = xfce_rc_read_int_entry(rc, app.rc.critical,
+                                                app.defaults.critical);
+        opts_thresholds_check(opts);
+        opts->notify =
+            xfce_rc_read_bool_entry(rc, app.rc.notify, app.defaults.notify);
+        if(stats_spec[i].path)
+          opts->cgroup = g_strdup(
+              xfce_rc_read_entry(rc, app.rc.cgroup, app.defaults.cgroup));
+        if(stats_spec[i].ceiling)
+          opts->rate =
+              xfce_rc_read_int_entry(rc, app.rc.rate, app.defaults.rate);
       }
       xfce_rc_close(rc);
     }
@@ -781,12 +3326,25 @@ static void plugin_opts_write(plugin_t* plugin) {
     if((rc = xfce_rc_simple_open(file, FALSE))) {
       for(i = 0; i < app.monitors; i++) {
         opts = &plugin->monitors[i].opts;
-        xfce_rc_set_group(rc, spec[i].name);
+        xfce_rc_set_group(rc, stats_spec[i].name);
         xfce_rc_write_bool_entry(rc, app.rc.enable, opts->enable);
         xfce_rc_write_bool_entry(rc, app.rc.icon, opts->icon);
         xfce_rc_write_int_entry(rc, app.rc.period, opts->period);
         xfce_rc_write_int_entry(rc, app.rc.border, opts->border);
         xfce_rc_write_int_entry(rc, app.rc.padding, opts->padding);
+        xfce_rc_write_bool_entry(rc, app.rc.themed, opts->themed);
+        xfce_rc_write_bool_entry(rc, app.rc.ramp, opts->ramp);
+        xfce_rc_write_bool_entry(rc, app.rc.pressure, opts->pressure);
+        xfce_rc_write_bool_entry(rc, app.rc.adaptive, opts->adaptive);
+        xfce_rc_write_int_entry(rc, app.rc.ceiling, opts->ceiling);
+        xfce_rc_write_int_entry(rc, app.rc.display, opts->display);
+        xfce_rc_write_int_entry(rc, app.rc.warning, opts->warning);
+        xfce_rc_write_int_entry(rc, app.rc.critical, opts->critical);
+        xfce_rc_write_bool_entry(rc, app.rc.notify, opts->notify);
+        if(stats_spec[i].path)
+          xfce_rc_write_entry(rc, app.rc.cgroup, opts->cgroup);
+        if(stats_spec[i].ceiling)
+          xfce_rc_write_int_entry(rc, app.rc.rate, opts->rate);
       }
       xfce_rc_close(rc);
     }
@@ -801,6 +3359,27 @@ static void plugin_update_gui(plugin_t* plugin) {
     monitor_update_gui(&plugin->monitors[i]);
 }
 
+/* The icons and the dials are the same size */
+static void plugin_update_pixbufs(plugin_t* plugin) {
+  monitor_t* monitor = &plugin->monitors[RAM];
+  opts_t*    opts    = &monitor->opts;
+  guint      border  = opts->border;
+  guint      padding = opts->padding;
+  gint64     start   = probe_now();
+  guint      size    = xfce_panel_plugin_get_size(plugin->xfce);
+  guint      i       = 0;
+
+  if(size > border * 2 + padding * 2)
+    size = size - border * 2 - padding * 2;
+  else
+    size = 1;
+
+  for(i = 0; i < app.monitors; i++)
+    monitor_invalidate(&plugin->monitors[i]);
+  pixbufs_update(&plugin->pixbufs, size, opts->themed);
+  probe_record(PROBE_PIXBUFS, start);
+}
+
 static void plugin_update_timer(plugin_t* plugin) {
   guint i = 0;
 
@@ -823,7 +3402,7 @@ static void plugin_about(XfcePanelPlugin* plugin) {
   GdkPixbuf*   icon;
   const gchar* auth[] = {"Tarun Prabhu <tarun.prabhu@gmail.com>", NULL};
 
-  icon = xfce_panel_pixbuf_from_source(spec[RAM].icon, NULL, 32);
+  icon = xfce_panel_pixbuf_from_source(pixbufs_spec[RAM].icon, NULL, 32);
   gtk_show_about_dialog(
       NULL, "logo", icon, "license",
       xfce_get_license_text(XFCE_LICENSE_TEXT_GPL), "version", VERSION,
@@ -839,16 +3418,57 @@ static void plugin_about(XfcePanelPlugin* plugin) {
 
 static void plugin_handle_resize(plugin_t* plugin, int size) {
   XfcePanelPlugin* xfce    = plugin->xfce;
-  pixbufs_t*       pixbufs = &plugin->pixbufs;
   monitor_t*       monitor = &plugin->monitors[RAM];
 
-  pixbufs_update(pixbufs, plugin);
+  plugin_update_pixbufs(plugin);
+  plugin_update_gui(plugin);
+}
+
+/* The pixbuf cache has already dropped the entries for the theme by the time
+   this is called */
+static void plugin_handle_theme_change(plugin_t* plugin) {
+  pixbufs_t* pixbufs = &plugin->pixbufs;
+
+  pixbufs_delete_tooltips(pixbufs);
+  plugin_update_pixbufs(plugin);
   plugin_update_gui(plugin);
 }
 
+static void plugin_handle_pixbufs_loaded(plugin_t* plugin) {
+  pixbufs_t* pixbufs = &plugin->pixbufs;
+  guint      i       = 0;
+
+  if(pixbufs->pending) {
+    plugin_update_pixbufs(plugin);
+    plugin_update_gui(plugin);
+  }
+  if(pixbufs->tooltips_pending) {
+    pixbufs_load_tooltips(pixbufs);
+    for(i = 0; pixbufs->tooltips_loaded && i < app.monitors; i++)
+      gtk_widget_trigger_tooltip_query(plugin->monitors[i].gui.grid);
+  }
+}
+
+/* The plugin has been removed from the panel, so nothing should be left
+   behind. The history is still mapped until the plugin is freed, but it goes
+   away with the last reference. The monitors that are disabled may have
+   left a history behind from when they were enabled */
+static void plugin_handle_remove(plugin_t* plugin) {
+  monitor_t* monitor = NULL;
+  guint      i       = 0;
+
+  for(i = 0; i < app.monitors; i++) {
+    monitor = &plugin->monitors[i];
+    if(monitor->file)
+      g_unlink(monitor->file);
+  }
+}
+
 static gboolean plugin_handle_remote_event(plugin_t*     plugin,
                                            const gchar*  name,
                                            const GValue* value) {
+  gchar* report = NULL;
+
   if(value && G_IS_VALUE(value)) {
     if(strcmp(name, "refresh") == 0) {
       if(G_VALUE_HOLDS_BOOLEAN(value) && g_value_get_boolean(value)) {
@@ -856,11 +3476,49 @@ static gboolean plugin_handle_remote_event(plugin_t*     plugin,
       }
       return TRUE;
     }
+    /* Logs what the plugin has cost so far and adds the diagnostics tab to
+       the config dialog from now on */
+    if(strcmp(name, "diagnostics") == 0) {
+      if(G_VALUE_HOLDS_BOOLEAN(value) && g_value_get_boolean(value)) {
+        report = probe_report();
+        g_message("%s", report);
+        g_free(report);
+        plugin->diagnostics.shown = TRUE;
+      }
+      return TRUE;
+    }
   }
 
   return FALSE;
 }
 
+static void plugin_handle_method_call(plugin_t*              plugin,
+                                      const gchar*           method,
+                                      GVariant*              params,
+                                      GDBusMethodInvocation* invocation) {
+  const gchar*   name  = NULL;
+  guint          value = 0;
+  const range_t* range = &app.config.period;
+
+  if(strcmp(method, "GetSnapshot") == 0) {
+    g_dbus_method_invocation_return_value(invocation,
+                                          bus_get_snapshot(plugin));
+  } else if(strcmp(method, "SetPeriod") == 0) {
+    g_variant_get(params, "(&su)", &name, &value);
+    if(bus_set_period(plugin, name, value))
+      g_dbus_method_invocation_return_value(invocation, NULL);
+    else
+      g_dbus_method_invocation_return_error(
+          invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+          "No monitor named '%s' or the period is not in %g-%g s", name,
+          range->min, range->max);
+  } else if(strcmp(method, "Burst") == 0) {
+    g_variant_get(params, "(u)", &value);
+    bus_burst(plugin, value);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+  }
+}
+
 static void plugin_handle_reorient(plugin_t*      plugin,
                                    GtkOrientation orientation) {
   gtk_orientable_set_orientation(GTK_ORIENTABLE(plugin->box), orientation);
@@ -870,6 +3528,7 @@ static void plugin_handle_reorient(plugin_t*      plugin,
 static void plugin_construct(plugin_t* plugin, XfcePanelPlugin* xfce) {
   GtkWidget *    evt, *box;
   GtkOrientation orientation;
+  GtkIconTheme*  theme   = NULL;
   monitor_t*     monitor = NULL;
   gui_t*         gui     = NULL;
   opts_t*        opts    = NULL;
@@ -877,10 +3536,17 @@ static void plugin_construct(plugin_t* plugin, XfcePanelPlugin* xfce) {
   guint          i       = 0;
 
   orientation = xfce_panel_plugin_get_orientation(xfce);
+  theme =
+      gtk_icon_theme_get_for_screen(gtk_widget_get_screen(GTK_WIDGET(xfce)));
 
-  plugin->xfce = xfce;
+  plugin->xfce            = xfce;
+  plugin->listener.notify = cb_plugin_pixbufs_loaded;
+  plugin->listener.data   = plugin;
+  pixbufs->theme          = theme;
+  sampler_ref();
+  scanner_ref();
+  pixcache_ref(&plugin->listener);
   plugin_opts_read(plugin);
-  pixbufs_create(pixbufs, plugin);
   for(i = 0; i < app.monitors; i++)
     monitor_construct(&plugin->monitors[i], i, plugin);
 
@@ -905,15 +3571,43 @@ static void plugin_construct(plugin_t* plugin, XfcePanelPlugin* xfce) {
 
   plugin->evt = evt;
   plugin->box = box;
+
+  /* This must run after the pixbuf cache has dropped the stale entries */
+  g_signal_connect_after(theme, "changed", G_CALLBACK(cb_plugin_theme_changed),
+                         plugin);
+
+  plugin_update_timer(plugin);
+  snapshot_ref(plugin);
+  bus_ref(plugin);
 }
 
 static void plugin_delete(plugin_t* plugin) {
-  pixbufs_t* pixbufs = &plugin->pixbufs;
-  guint      i       = 0;
+  XfcePanelPlugin* xfce    = plugin->xfce;
+  GtkIconTheme*    theme   = NULL;
+  pixbufs_t*       pixbufs = &plugin->pixbufs;
+  guint            i       = 0;
+
+  theme =
+      gtk_icon_theme_get_for_screen(gtk_widget_get_screen(GTK_WIDGET(xfce)));
+  g_signal_handlers_disconnect_by_func(theme, (gpointer)cb_plugin_theme_changed,
+                                       plugin);
+  /* The config dialog may outlive the plugin */
+  if(plugin->diagnostics.label) {
+    g_signal_handlers_disconnect_by_func(
+        plugin->diagnostics.label,
+        (gpointer)cb_config_diagnostics_destroyed, plugin);
+    g_source_remove(plugin->diagnostics.timer);
+  }
 
+  bus_unref(plugin);
+  snapshot_unref(plugin);
   for(i = 0; i < app.monitors; i++)
     monitor_delete(&plugin->monitors[i]);
   pixbufs_delete(pixbufs);
+  pixbufs_delete_tooltips(pixbufs);
+  pixcache_unref(&plugin->listener);
+  scanner_unref();
+  sampler_unref();
   g_free(plugin);
 }
 
@@ -924,6 +3618,26 @@ static void cb_config_period_changed(GtkWidget* spin, void* data) {
   double     period  = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
 
   opts_period_changed(opts, period);
+  monitor_set_period(monitor, 0);
+}
+
+static void cb_config_adaptive_toggled(GtkWidget* chk, void* data) {
+  monitor_t* monitor  = (monitor_t*)data;
+  opts_t*    opts     = &monitor->opts;
+  config_t*  config   = &monitor->config;
+  gboolean   adaptive = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(chk));
+
+  opts_adaptive_toggled(opts, adaptive);
+  gtk_widget_set_sensitive(config->spin_ceiling, adaptive);
+  monitor_update_timer(monitor);
+}
+
+static void cb_config_ceiling_changed(GtkWidget* spin, void* data) {
+  monitor_t* monitor = (monitor_t*)data;
+  opts_t*    opts    = &monitor->opts;
+  double     ceiling = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
+
+  opts_ceiling_changed(opts, ceiling);
   monitor_update_timer(monitor);
 }
 
@@ -935,6 +3649,8 @@ static void cb_config_enable_toggled(GtkWidget* chk, void* data) {
 
   opts_enable_toggled(opts, enabled);
   config_dialog_update_gui(config, enabled);
+  /* The history has to be open before the graph can be drawn from it */
+  monitor_update_timer(monitor);
   monitor_update_gui(monitor);
 }
 
@@ -952,7 +3668,6 @@ static void cb_config_border_changed(GtkWidget* spin, void* data) {
   guint      border  = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
   monitor_t* monitor = NULL;
   opts_t*    opts    = NULL;
-  pixbufs_t* pixbufs = &plugin->pixbufs;
   guint      i       = 0;
 
   for(i = 0; i < app.monitors; i++) {
@@ -960,7 +3675,7 @@ static void cb_config_border_changed(GtkWidget* spin, void* data) {
     opts    = &monitor->opts;
     opts_border_changed(opts, border);
   }
-  pixbufs_update(pixbufs, plugin);
+  plugin_update_pixbufs(plugin);
   plugin_update_gui(plugin);
 }
 
@@ -969,7 +3684,6 @@ static void cb_config_padding_changed(GtkWidget* spin, void* data) {
   guint      padding = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
   monitor_t* monitor = NULL;
   opts_t*    opts    = NULL;
-  pixbufs_t* pixbufs = &plugin->pixbufs;
   guint      i       = 0;
 
   for(i = 0; i < app.monitors; i++) {
@@ -977,15 +3691,131 @@ static void cb_config_padding_changed(GtkWidget* spin, void* data) {
     opts    = &monitor->opts;
     opts_padding_changed(opts, padding);
   }
-  pixbufs_update(pixbufs, plugin);
+  plugin_update_pixbufs(plugin);
+  plugin_update_gui(plugin);
+}
+
+static void cb_config_themed_toggled(GtkWidget* chk, void* data) {
+  plugin_t*  plugin  = (plugin_t*)data;
+  gboolean   themed  = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(chk));
+  GtkWidget* ramp    = (GtkWidget*)g_object_get_data(G_OBJECT(chk), "ramp");
+  guint      i       = 0;
+
+  for(i = 0; i < app.monitors; i++)
+    opts_themed_toggled(&plugin->monitors[i].opts, themed);
+  gtk_widget_set_sensitive(ramp, !themed);
+  plugin_update_pixbufs(plugin);
+  plugin_update_gui(plugin);
+}
+
+static void cb_config_ramp_toggled(GtkWidget* chk, void* data) {
+  plugin_t* plugin = (plugin_t*)data;
+  gboolean  ramp   = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(chk));
+  guint     i      = 0;
+
+  for(i = 0; i < app.monitors; i++) {
+    opts_ramp_toggled(&plugin->monitors[i].opts, ramp);
+    monitor_invalidate(&plugin->monitors[i]);
+  }
+  plugin_update_gui(plugin);
+}
+
+static void cb_config_cgroup_changed(GtkWidget* txt, void* data) {
+  monitor_t*   monitor = (monitor_t*)data;
+  const gchar* cgroup  = gtk_entry_get_text(GTK_ENTRY(txt));
+
+  monitor_set_cgroup(monitor, cgroup);
+}
+
+static gboolean
+cb_config_cgroup_focus_out(GtkWidget* txt, GdkEventFocus*, void* data) {
+  cb_config_cgroup_changed(txt, data);
+  return FALSE;
+}
+
+/* The other threshold is moved along so that the warning is never above the
+   critical threshold. Its own callback updates the opts */
+static void cb_config_warning_changed(GtkWidget* spin, void* data) {
+  monitor_t* monitor = (monitor_t*)data;
+  opts_t*    opts    = &monitor->opts;
+  config_t*  config  = &monitor->config;
+  guint      warning = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
+
+  opts_warning_changed(opts, warning);
+  if(warning > opts->critical)
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(config->spin_critical), warning);
+  monitor_update_gui(monitor);
+}
+
+static void cb_config_critical_changed(GtkWidget* spin, void* data) {
+  monitor_t* monitor  = (monitor_t*)data;
+  opts_t*    opts     = &monitor->opts;
+  config_t*  config   = &monitor->config;
+  guint      critical = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
+
+  opts_critical_changed(opts, critical);
+  if(critical < opts->warning)
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(config->spin_warning), critical);
+  monitor_update_gui(monitor);
+}
+
+static void cb_config_rate_changed(GtkWidget* spin, void* data) {
+  monitor_t* monitor = (monitor_t*)data;
+  opts_t*    opts    = &monitor->opts;
+  guint      rate    = gtk_spin_button_get_value(GTK_SPIN_BUTTON(spin));
+
+  opts_rate_changed(opts, rate);
+  monitor_sync(monitor);
+  monitor->tooltip.valid = FALSE;
   monitor_update_gui(monitor);
 }
 
+static void cb_config_notify_toggled(GtkWidget* chk, void* data) {
+  monitor_t* monitor = (monitor_t*)data;
+  opts_t*    opts    = &monitor->opts;
+  gboolean   notify  = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(chk));
+
+  opts_notify_toggled(opts, notify);
+}
+
+static void cb_config_display_changed(GtkWidget* cmb, void* data) {
+  plugin_t* plugin  = (plugin_t*)data;
+  gint      display = gtk_combo_box_get_active(GTK_COMBO_BOX(cmb));
+  guint     i       = 0;
+
+  for(i = 0; i < app.monitors; i++) {
+    opts_display_changed(&plugin->monitors[i].opts, display);
+    monitor_invalidate(&plugin->monitors[i]);
+  }
+  plugin_update_gui(plugin);
+}
+
+static void cb_config_pressure_toggled(GtkWidget* chk, void* data) {
+  plugin_t* plugin   = (plugin_t*)data;
+  gboolean  pressure = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(chk));
+  guint     i        = 0;
+
+  for(i = 0; i < app.monitors; i++)
+    opts_pressure_toggled(&plugin->monitors[i].opts, pressure);
+  plugin_update_timer(plugin);
+}
+
 static void
 cb_config_response(GtkWidget* dialog, int response, plugin_t* plugin) {
   config_dialog_response(plugin, dialog, response);
 }
 
+static gboolean cb_config_diagnostics_tick(void* data) {
+  config_dialog_update_diagnostics((plugin_t*)data);
+  return TRUE;
+}
+
+static void cb_config_diagnostics_destroyed(GtkWidget*, plugin_t* plugin) {
+  g_source_remove(plugin->diagnostics.timer);
+  plugin->diagnostics.timer = 0;
+  plugin->diagnostics.label = NULL;
+}
+
 /* Plugin callbacks */
 static void cb_plugin_about(XfcePanelPlugin* plugin) {
   plugin_about(plugin);
@@ -1013,6 +3843,10 @@ static gboolean cb_plugin_remote_event(XfcePanelPlugin* xfce,
   return plugin_handle_remote_event(plugin, name, value);
 }
 
+static void cb_plugin_remove(XfcePanelPlugin* xfce, plugin_t* plugin) {
+  plugin_handle_remove(plugin);
+}
+
 static void cb_plugin_save(XfcePanelPlugin* xfce, plugin_t* plugin) {
   plugin_opts_write(plugin);
 }
@@ -1023,9 +3857,109 @@ static void cb_plugin_size_changed(XfcePanelPlugin* panel_plugin,
   plugin_handle_resize(plugin, size);
 }
 
+/* Sampler callbacks */
+static gboolean cb_sampler_timer_tick(void*) {
+  sampler_tick(FALSE);
+  return TRUE;
+}
+
+static gboolean cb_sampler_idle(void*) {
+  sampler.idle = 0;
+  sampler_tick(FALSE);
+  return FALSE;
+}
+
+static gboolean cb_sampler_pressure(gint fd, GIOCondition cond, void*) {
+  if(cond & G_IO_ERR) {
+    /* The trigger has gone away, so go back to polling normally */
+    sampler.psi_watch = 0;
+    sampler_close_pressure();
+    sampler_update_timer();
+    return FALSE;
+  }
+
+  sampler_tick(TRUE);
+  return TRUE;
+}
+
+static gboolean cb_sampler_done(gint, GIOCondition, void*) {
+  probe.wakeups++;
+  sampler_drain();
+  return TRUE;
+}
+
+static gpointer cb_sampler_thread(gpointer data) {
+  sampler_run((worker_t*)data);
+  return NULL;
+}
+
+/* Bus callbacks */
+static void
+cb_bus_acquired(GDBusConnection* connection, const gchar*, void* data) {
+  bus_acquired((plugin_t*)data, connection);
+}
+
+static void
+cb_bus_name_lost(GDBusConnection* connection, const gchar*, void* data) {
+  bus_name_lost((plugin_t*)data, connection);
+}
+
+static void cb_bus_method_call(GDBusConnection*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar*           method,
+                               GVariant*              params,
+                               GDBusMethodInvocation* invocation,
+                               void*                  data) {
+  plugin_handle_method_call((plugin_t*)data, method, params, invocation);
+}
+
+static void cb_plugin_theme_changed(GtkIconTheme* theme, plugin_t* plugin) {
+  plugin_handle_theme_change(plugin);
+}
+
+static void cb_plugin_pixbufs_loaded(void* data) {
+  plugin_handle_pixbufs_loaded((plugin_t*)data);
+}
+
+/* Scanner callbacks */
+static gboolean cb_scanner_timer_tick(void*) {
+  probe.wakeups++;
+  return scanner_timer_tick();
+}
+
+static gboolean cb_scanner_pause(void*) {
+  scanner.pause = 0;
+  scanner_slice();
+  return FALSE;
+}
+
+static void cb_scanner_done(GObject*, GAsyncResult* result, void*) {
+  scanner_done(G_TASK(result));
+}
+
+static gboolean cb_walk_settle(gpointer, gpointer value, gpointer data) {
+  return walk_settle((walk_t*)data, (tracked_t*)value);
+}
+
 /* Monitor callbacks */
-static int cb_monitor_timer_tick(void* p) {
-  return monitor_timer_tick((monitor_t*)p);
+static gboolean cb_reading_read(const meminfo_t* meminfo, void* data) {
+  return reading_read((reading_t*)data, meminfo);
+}
+
+static void cb_reading_release(void* data) {
+  reading_delete((reading_t*)data);
+}
+
+static void cb_monitor_sample(gboolean ok, gint64 time, void* data) {
+  monitor_sample((monitor_t*)data, ok, time);
+}
+
+static gboolean
+cb_monitor_draw_graph(GtkWidget* widget, cairo_t* cr, monitor_t* monitor) {
+  monitor_draw_graph(monitor, cr);
+  return FALSE;
 }
 
 static gboolean cb_monitor_gen_tooltip(GtkWidget*  widget,
@@ -1034,7 +3968,7 @@ static gboolean cb_monitor_gen_tooltip(GtkWidget*  widget,
                                        gboolean    keyboard_mode,
                                        GtkTooltip* tooltip,
                                        monitor_t*  monitor) {
-  return spec[monitor->id].gen_tooltip(monitor, tooltip);
+  return monitor_gen_tooltip(monitor, tooltip);
 }
 
 /* Main plugin constructor */
@@ -1057,6 +3991,7 @@ extern "C" void memory_monitor_construct_impl(XfcePanelPlugin* xfce) {
                    G_CALLBACK(cb_plugin_orientation_changed), plugin);
   g_signal_connect(xfce, "remote-event", G_CALLBACK(cb_plugin_remote_event),
                    plugin);
+  g_signal_connect(xfce, "remove", G_CALLBACK(cb_plugin_remove), plugin);
   g_signal_connect(xfce, "save", G_CALLBACK(cb_plugin_save), plugin);
   g_signal_connect(xfce, "size-changed", G_CALLBACK(cb_plugin_size_changed),
                    plugin);
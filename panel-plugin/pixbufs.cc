@@ -0,0 +1,516 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "pixbufs.h"
+
+#include <cmath>
+#include <cstring>
+
+/* The pixbufs decoded from an icon theme at a given size */
+typedef struct {
+  GtkIconTheme* theme;
+  guint         size;
+  gboolean      themed; /* Whether the dials are wanted */
+  gboolean      icons_loaded;
+  gboolean      dials_loaded;
+  GTask*        task; /* The load in progress, if any */
+  GdkPixbuf*    icons[stats_app.monitors];
+  GdkPixbuf*    dials[pixbufs_app.dials.count];
+} pixcache_entry_t;
+
+/* A request to decode pixbufs on a worker thread. The file names are looked
+   up on the main thread. The icons are at the start of the arrays, followed
+   by the dials */
+typedef struct {
+  guint      size;
+  gboolean   icons;
+  gboolean   dials;
+  gchar*     files[stats_app.monitors + pixbufs_app.dials.count];
+  GdkPixbuf* pixbufs[stats_app.monitors + pixbufs_app.dials.count];
+} pixcache_load_t;
+
+/* There is only one pixbuf cache in the process. Entries are keyed by icon
+   theme and size and the least recently used one is evicted when there are
+   more than pixbufs_app.cache of them. Users take their own references to
+   the pixbufs so evicting an entry never frees a pixbuf that is still shown.
+   Decoding happens in the background and the listeners are notified every
+   time an entry has been loaded */
+typedef struct {
+  guint   refs;
+  GList*  entries;   /* Most recently used first */
+  GSList* themes;    /* Themes whose "changed" signal has been connected */
+  GSList* listeners;
+} pixcache_t;
+
+/* Pixbuf cache callbacks */
+static void cb_pixcache_theme_changed(GtkIconTheme*, void*);
+static void cb_pixcache_loaded(GObject*, GAsyncResult*, void*);
+
+/* Pixbuf cache functions */
+static pixcache_entry_t* pixcache_lookup(GtkIconTheme*, guint, gboolean);
+static void              pixcache_drop(GtkIconTheme*);
+
+const pixbufs_spec_t pixbufs_spec[stats_app.monitors] = {
+    {"xfce-applet-memory-ram", NULL},    /* [0] */
+    {"xfce-applet-memory-swap", NULL},   /* [1] */
+    {"xfce-applet-memory-ram", "CG"},    /* [2] */
+    {"xfce-applet-memory-ram", "SHM"},   /* [3] */
+    {"xfce-applet-memory-ram", "DRT"},   /* [4] */
+    {"xfce-applet-memory-ram", "ANON"},  /* [5] */
+    {"xfce-applet-memory-ram", "LCK"},   /* [6] */
+    {"xfce-applet-memory-ram", "CMT"},   /* [7] */
+    {"xfce-applet-memory-swap", "Z"},    /* [8] */
+    {"xfce-applet-memory-ram", "NUMA"},  /* [9] */
+    {"xfce-applet-memory-swap", "IO"}    /* [10] */
+};
+
+static pixcache_t pixcache;
+
+static gchar*
+get_pixbuf_file(const gchar* base, GtkIconTheme* theme, guint size) {
+  gchar*       file = NULL;
+  GtkIconInfo* info = NULL;
+
+  if((info = gtk_icon_theme_lookup_icon(theme, base, size,
+                                        static_cast<GtkIconLookupFlags>(0)))) {
+    file = g_strdup(gtk_icon_info_get_filename(info));
+
+    g_object_unref(G_OBJECT(info));
+  }
+
+  return file;
+}
+
+/* p is the fraction used */
+/* A monitor that needs attention is drawn in the colour it is given
+   regardless of the ramp */
+void set_source_usage(cairo_t*       cr,
+                      gdouble        p,
+                      gboolean       ramp,
+                      const gdouble* colour) {
+  if(colour)
+    cairo_set_source_rgb(cr, colour[0], colour[1], colour[2]);
+  else if(ramp)
+    cairo_set_source_rgb(cr, MIN(1.0, 2 * p), MIN(1.0, 2 * (1 - p)), 0);
+  else
+    cairo_set_source_rgb(cr, 0.20, 0.40, 0.64);
+}
+
+/* Draws a dial showing percent in the same style as the themed icons. If
+   ramp is set, the arc goes from green to red as the percentage increases */
+GdkPixbuf* dial_render(guint          size,
+                       guint          percent,
+                       gboolean       ramp,
+                       const gdouble* colour) {
+  cairo_surface_t* surface = NULL;
+  cairo_t*         cr      = NULL;
+  GdkPixbuf*       pb      = NULL;
+  gdouble          p       = MIN(percent, 100) / 100.0;
+  gdouble          width   = size / 6.0;
+  gdouble          radius  = size / 2.0 - width / 2.0;
+  gdouble          cx      = size / 2.0;
+  gdouble          cy      = size / 2.0 + radius / 2.0;
+  gdouble          angle   = G_PI + G_PI * p;
+
+  if(!size)
+    return NULL;
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+  cr      = cairo_create(surface);
+
+  cairo_set_line_width(cr, width);
+  cairo_set_source_rgba(cr, 0.5, 0.5, 0.5, 0.35);
+  cairo_arc(cr, cx, cy, radius, G_PI, 2 * G_PI);
+  cairo_stroke(cr);
+
+  set_source_usage(cr, p, ramp, colour);
+  cairo_arc(cr, cx, cy, radius, G_PI, angle);
+  cairo_stroke(cr);
+
+  cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+  cairo_set_line_width(cr, MAX(1.0, size / 16.0));
+  cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+  cairo_move_to(cr, cx, cy);
+  cairo_line_to(cr, cx + radius * cos(angle), cy + radius * sin(angle));
+  cairo_stroke(cr);
+  cairo_arc(cr, cx, cy, width / 2, 0, 2 * G_PI);
+  cairo_fill(cr);
+
+  cairo_destroy(cr);
+  pb = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
+  cairo_surface_destroy(surface);
+
+  return pb;
+}
+
+/* Draws a ring for each NUMA node, the first one outermost, in a dial of
+   the same size as the one drawn by dial_render(). There is no needle
+   since there is no single value to point at */
+GdkPixbuf* dial_render_split(guint               size,
+                             const stats_numa_t* numa,
+                             gboolean            ramp,
+                             const gdouble*      colour) {
+  cairo_surface_t*   surface = NULL;
+  cairo_t*           cr      = NULL;
+  GdkPixbuf*         pb      = NULL;
+  const numa_node_t* node    = NULL;
+  gdouble            band    = size / 3.0;
+  gdouble            width   = band / numa->count;
+  gdouble            outer   = size / 2.0 - size / 12.0; /* As in dial_render */
+  gdouble            cx      = size / 2.0;
+  gdouble            cy      = size / 2.0 + outer / 2.0;
+  gdouble            radius  = 0;
+  gdouble            p       = 0;
+  guint              i       = 0;
+
+  if(!size)
+    return NULL;
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+  cr      = cairo_create(surface);
+
+  cairo_set_line_width(cr, MAX(1.0, width - 1));
+  for(i = 0; i < numa->count; i++) {
+    node   = &numa->nodes[i];
+    p      = MIN(get_percent(node->total, node->free), 100) / 100.0;
+    radius = size / 2.0 - (i + 0.5) * width;
+
+    cairo_set_source_rgba(cr, 0.5, 0.5, 0.5, 0.35);
+    cairo_arc(cr, cx, cy, radius, G_PI, 2 * G_PI);
+    cairo_stroke(cr);
+
+    set_source_usage(cr, p, ramp, colour);
+    cairo_arc(cr, cx, cy, radius, G_PI, G_PI + G_PI * p);
+    cairo_stroke(cr);
+  }
+
+  cairo_destroy(cr);
+  pb = gdk_pixbuf_get_from_surface(surface, 0, 0, size, size);
+  cairo_surface_destroy(surface);
+
+  return pb;
+}
+
+static void pixcache_load_delete(void* data) {
+  pixcache_load_t* load = (pixcache_load_t*)data;
+  guint            i    = 0;
+
+  for(i = 0; i < G_N_ELEMENTS(load->files); i++) {
+    g_free(load->files[i]);
+    if(load->pixbufs[i])
+      g_object_unref(G_OBJECT(load->pixbufs[i]));
+  }
+  g_free(load);
+}
+
+/* Returns a copy of the icon with the badge drawn along its bottom edge so
+   that the monitors that share an icon can be told apart. The text is
+   outlined so that it can be read on any part of the icon */
+static GdkPixbuf* pixbuf_badge(GdkPixbuf* icon, const gchar* badge) {
+  cairo_surface_t*     surface = NULL;
+  cairo_t*             cr      = NULL;
+  GdkPixbuf*           pb      = NULL;
+  cairo_text_extents_t extents;
+  gint                 width   = gdk_pixbuf_get_width(icon);
+  gint                 height  = gdk_pixbuf_get_height(icon);
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  cr      = cairo_create(surface);
+
+  gdk_cairo_set_source_pixbuf(cr, icon, 0, 0);
+  cairo_paint(cr);
+
+  cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL,
+                         CAIRO_FONT_WEIGHT_BOLD);
+  cairo_set_font_size(cr, height / 2.5);
+  cairo_text_extents(cr, badge, &extents);
+  if(extents.width > width - 2)
+    cairo_set_font_size(cr, height / 2.5 * (width - 2) / extents.width);
+  cairo_text_extents(cr, badge, &extents);
+  cairo_move_to(cr, (width - extents.width) / 2 - extents.x_bearing,
+                height - 1 - (extents.height + extents.y_bearing));
+  cairo_text_path(cr, badge);
+  cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+  cairo_set_line_width(cr, MAX(1.0, height / 16.0));
+  cairo_stroke_preserve(cr);
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_fill(cr);
+
+  cairo_destroy(cr);
+  pb = gdk_pixbuf_get_from_surface(surface, 0, 0, width, height);
+  cairo_surface_destroy(surface);
+
+  return pb;
+}
+
+/* This runs on a worker thread. Only the decoding is done here because the
+   icon theme itself must only be used from the main thread */
+static void pixcache_load_thread(GTask*        task,
+                                 gpointer      source,
+                                 gpointer      data,
+                                 GCancellable* cancellable) {
+  pixcache_load_t* load  = (pixcache_load_t*)data;
+  GdkPixbuf*       plain = NULL;
+  guint            i     = 0;
+
+  for(i = 0; i < G_N_ELEMENTS(load->files); i++)
+    if(load->files[i])
+      load->pixbufs[i] = gdk_pixbuf_new_from_file_at_scale(
+          load->files[i], load->size, load->size, TRUE, NULL);
+  for(i = 0; load->icons && i < stats_app.monitors; i++) {
+    if(!(plain = load->pixbufs[i]) || !pixbufs_spec[i].badge)
+      continue;
+    load->pixbufs[i] = pixbuf_badge(plain, pixbufs_spec[i].badge);
+    g_object_unref(G_OBJECT(plain));
+  }
+  g_task_return_boolean(task, TRUE);
+}
+
+/* Starts loading whatever the entry is missing unless a load is already in
+   progress, in which case this is called again when it completes */
+static void pixcache_entry_load(pixcache_entry_t* entry) {
+  pixcache_load_t* load  = NULL;
+  gchar*           base  = NULL;
+  GTask*           task  = NULL;
+  gboolean         icons = !entry->icons_loaded;
+  gboolean         dials = entry->themed && !entry->dials_loaded;
+  guint            i     = 0;
+
+  if(entry->task || !(icons || dials))
+    return;
+
+  load        = g_new0(pixcache_load_t, 1);
+  load->size  = entry->size;
+  load->icons = icons;
+  load->dials = dials;
+  for(i = 0; icons && i < stats_app.monitors; i++)
+    load->files[i] =
+        get_pixbuf_file(pixbufs_spec[i].icon, entry->theme, entry->size);
+  for(i = 0; dials && i < pixbufs_app.dials.count; i++) {
+    base = g_strdup_printf(pixbufs_app.dials.base, i * 5);
+    load->files[stats_app.monitors + i] =
+        get_pixbuf_file(base, entry->theme, entry->size);
+    g_free(base);
+  }
+
+  task = g_task_new(NULL, NULL, cb_pixcache_loaded, NULL);
+  g_task_set_task_data(task, load, pixcache_load_delete);
+  g_task_run_in_thread(task, pixcache_load_thread);
+  entry->task = task;
+  g_object_unref(G_OBJECT(task));
+}
+
+static void pixcache_entry_delete(pixcache_entry_t* entry) {
+  guint i = 0;
+
+  for(i = 0; i < stats_app.monitors; i++)
+    if(entry->icons[i])
+      g_object_unref(G_OBJECT(entry->icons[i]));
+  for(i = 0; i < pixbufs_app.dials.count; i++)
+    if(entry->dials[i])
+      g_object_unref(G_OBJECT(entry->dials[i]));
+  g_free(entry);
+}
+
+/* Moves the pixbufs that were decoded into the entry that requested them. If
+   the entry was evicted or dropped in the meantime, they are discarded */
+static void pixcache_loaded(GTask* task) {
+  GList*            l     = NULL;
+  GSList*           s     = NULL;
+  pixcache_entry_t* entry = NULL;
+  pixcache_load_t*  load  = (pixcache_load_t*)g_task_get_task_data(task);
+  listener_t*       lst   = NULL;
+  guint             i     = 0;
+
+  for(l = pixcache.entries; l; l = l->next)
+    if(((pixcache_entry_t*)l->data)->task == task)
+      entry = (pixcache_entry_t*)l->data;
+  if(!entry)
+    return;
+
+  for(i = 0; load->icons && i < stats_app.monitors; i++) {
+    entry->icons[i]  = load->pixbufs[i];
+    load->pixbufs[i] = NULL;
+  }
+  for(i = 0; load->dials && i < pixbufs_app.dials.count; i++) {
+    entry->dials[i] = load->pixbufs[stats_app.monitors + i];
+    load->pixbufs[stats_app.monitors + i] = NULL;
+  }
+  entry->icons_loaded |= load->icons;
+  entry->dials_loaded |= load->dials;
+  entry->task = NULL;
+
+  pixcache_entry_load(entry);
+  for(s = pixcache.listeners; s; s = s->next) {
+    lst = (listener_t*)s->data;
+    lst->notify(lst->data);
+  }
+}
+
+static gboolean pixcache_entry_is_ready(pixcache_entry_t* entry) {
+  return !entry->task && entry->icons_loaded &&
+         (!entry->themed || entry->dials_loaded);
+}
+
+void pixcache_ref(listener_t* lst) {
+  pixcache.refs++;
+  pixcache.listeners = g_slist_prepend(pixcache.listeners, lst);
+}
+
+void pixcache_unref(listener_t* lst) {
+  GList*  l = NULL;
+  GSList* t = NULL;
+
+  pixcache.listeners = g_slist_remove(pixcache.listeners, lst);
+  if(--pixcache.refs)
+    return;
+
+  for(l = pixcache.entries; l; l = l->next)
+    pixcache_entry_delete((pixcache_entry_t*)l->data);
+  for(t = pixcache.themes; t; t = t->next)
+    g_signal_handlers_disconnect_by_func(
+        t->data, (gpointer)cb_pixcache_theme_changed, NULL);
+  g_list_free(pixcache.entries);
+  g_slist_free(pixcache.themes);
+  memset(&pixcache, 0, sizeof(pixcache_t));
+}
+
+/* Returns the entry for the theme at the given size. This never blocks. If
+   the pixbufs have not been decoded yet, they are loaded in the background
+   and the listeners are notified when they are ready. The dials are only
+   loaded if themed is set */
+static pixcache_entry_t*
+pixcache_lookup(GtkIconTheme* theme, guint size, gboolean themed) {
+  GList*            l     = NULL;
+  pixcache_entry_t* entry = NULL;
+
+  for(l = pixcache.entries; l; l = l->next) {
+    entry = (pixcache_entry_t*)l->data;
+    if(entry->theme == theme && entry->size == size)
+      break;
+  }
+
+  if(l) {
+    pixcache.entries = g_list_remove_link(pixcache.entries, l);
+    pixcache.entries = g_list_concat(l, pixcache.entries);
+  } else {
+    entry            = g_new0(pixcache_entry_t, 1);
+    entry->theme     = theme;
+    entry->size      = size;
+    pixcache.entries = g_list_prepend(pixcache.entries, entry);
+
+    if(g_list_length(pixcache.entries) > pixbufs_app.cache) {
+      l = g_list_last(pixcache.entries);
+      pixcache_entry_delete((pixcache_entry_t*)l->data);
+      pixcache.entries = g_list_delete_link(pixcache.entries, l);
+    }
+
+    if(!g_slist_find(pixcache.themes, theme)) {
+      g_signal_connect(theme, "changed",
+                       G_CALLBACK(cb_pixcache_theme_changed), NULL);
+      pixcache.themes = g_slist_prepend(pixcache.themes, theme);
+    }
+  }
+
+  entry->themed |= themed;
+  pixcache_entry_load(entry);
+
+  return entry;
+}
+
+static void pixcache_drop(GtkIconTheme* theme) {
+  GList*            l     = pixcache.entries;
+  GList*            next  = NULL;
+  pixcache_entry_t* entry = NULL;
+
+  while(l) {
+    next  = l->next;
+    entry = (pixcache_entry_t*)l->data;
+    if(entry->theme == theme) {
+      pixcache_entry_delete(entry);
+      pixcache.entries = g_list_delete_link(pixcache.entries, l);
+    }
+    l = next;
+  }
+}
+
+static GdkPixbuf* pixbuf_ref(GdkPixbuf* pb) {
+  if(pb)
+    g_object_ref(G_OBJECT(pb));
+  return pb;
+}
+
+/* The tooltip icons are only loaded the first time a tooltip is shown */
+void pixbufs_load_tooltips(pixbufs_t* pixbufs) {
+  guint             size  = 96;
+  pixcache_entry_t* entry = NULL;
+  guint             i     = 0;
+
+  entry = pixcache_lookup(pixbufs->theme, size, FALSE);
+  if((pixbufs->tooltips_pending = !pixcache_entry_is_ready(entry)))
+    return;
+
+  for(i = 0; i < stats_app.monitors; i++) {
+    if(pixbufs->tooltips[i])
+      g_object_unref(G_OBJECT(pixbufs->tooltips[i]));
+    pixbufs->tooltips[i] = pixbuf_ref(entry->icons[i]);
+  }
+  pixbufs->tooltips_loaded = TRUE;
+}
+
+GdkPixbuf* pixbufs_get_tooltip(pixbufs_t* pixbufs, guint id) {
+  if(!pixbufs->tooltips_loaded)
+    pixbufs_load_tooltips(pixbufs);
+  return pixbufs->tooltips[id];
+}
+
+/* Until the pixbufs have been decoded, the monitors show placeholders. The
+   icons and the dials are the same size */
+void pixbufs_update(pixbufs_t* pixbufs, guint size, gboolean themed) {
+  pixcache_entry_t* entry = NULL;
+  guint             i     = 0;
+
+  pixbufs_delete(pixbufs);
+
+  entry            = pixcache_lookup(pixbufs->theme, size, themed);
+  pixbufs->pending = !pixcache_entry_is_ready(entry);
+  for(i = 0; !pixbufs->pending && i < stats_app.monitors; i++)
+    pixbufs->icons[i] = pixbuf_ref(entry->icons[i]);
+  for(i = 0; !pixbufs->pending && themed && i < pixbufs_app.dials.count; i++)
+    pixbufs->dials[i] = pixbuf_ref(entry->dials[i]);
+  pixbufs->size_dial = size;
+}
+
+void pixbufs_delete(pixbufs_t* pixbufs) {
+  guint i;
+
+  for(i = 0; i < stats_app.monitors; i++)
+    if(pixbufs->icons[i])
+      g_object_unref(G_OBJECT(pixbufs->icons[i]));
+  for(i = 0; i < pixbufs_app.dials.count; i++)
+    if(pixbufs->dials[i])
+      g_object_unref(G_OBJECT(pixbufs->dials[i]));
+  memset(pixbufs->icons, 0, sizeof(pixbufs->icons));
+  memset(pixbufs->dials, 0, sizeof(pixbufs->dials));
+}
+
+void pixbufs_delete_tooltips(pixbufs_t* pixbufs) {
+  guint i;
+
+  for(i = 0; i < stats_app.monitors; i++)
+    if(pixbufs->tooltips[i])
+      g_object_unref(G_OBJECT(pixbufs->tooltips[i]));
+  memset(pixbufs->tooltips, 0, sizeof(pixbufs->tooltips));
+  pixbufs->tooltips_loaded = FALSE;
+}
+
+/* Pixbuf cache callbacks */
+static void cb_pixcache_theme_changed(GtkIconTheme* theme, void*) {
+  pixcache_drop(theme);
+}
+
+static void cb_pixcache_loaded(GObject*, GAsyncResult* result, void*) {
+  pixcache_loaded(G_TASK(result));
+}
+
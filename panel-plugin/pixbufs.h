@@ -0,0 +1,73 @@
+#ifndef XFCE4_APPLET_MEMORY_PIXBUFS_H
+#define XFCE4_APPLET_MEMORY_PIXBUFS_H
+
+/* The icons and the dials of the monitors. The icons are decoded from an
+   icon theme and cached in the background, and the dials that are not
+   themed are drawn. This needs GTK but not the panel, so that it can be
+   benchmarked with a theme of its own */
+
+#include "stats.h"
+
+#include <gtk/gtk.h>
+
+/* The constants used for the pixbufs */
+typedef struct {
+  const guint cache; /* Number of sizes kept in the pixbuf cache */
+  struct {
+    const gchar* base;
+    const guint  count;
+  } dials;
+} pixbufs_app_t;
+
+static constexpr pixbufs_app_t pixbufs_app = {
+    16, /* cache */
+    {
+        "xfce-applet-memory-dial-%03d", /* base */
+        21 /* The dial moves from 0-100 in steps of 5 (inclusive) */
+    }      /* dials */
+};
+
+/* The icon of each monitor in stats_spec[] */
+typedef struct {
+  const gchar* icon;
+  const gchar* badge; /* Drawn on the icon when the icon is shared */
+} pixbufs_spec_t;
+
+extern const pixbufs_spec_t pixbufs_spec[stats_app.monitors];
+
+typedef struct {
+  void (*notify)(void*);
+  void* data;
+} listener_t;
+
+/* What a user of the cache has taken from it */
+typedef struct {
+  GtkIconTheme* theme;
+  guint         size_dial;
+  gboolean      pending;          /* Waiting for the icons and dials */
+  gboolean      tooltips_pending; /* Waiting for the tooltip icons */
+  gboolean      tooltips_loaded;
+  GdkPixbuf*    icons[stats_app.monitors];
+  GdkPixbuf*    tooltips[stats_app.monitors];
+  GdkPixbuf*    dials[pixbufs_app.dials.count]; /* Only for themed dials */
+} pixbufs_t;
+
+/* Pixbuf cache functions */
+/* The listener is notified every time the cache has loaded an entry */
+void pixcache_ref(listener_t*);
+void pixcache_unref(listener_t*);
+
+/* Pixbufs functions */
+void       pixbufs_update(pixbufs_t*, guint, gboolean);
+void       pixbufs_load_tooltips(pixbufs_t*);
+GdkPixbuf* pixbufs_get_tooltip(pixbufs_t*, guint);
+void       pixbufs_delete(pixbufs_t*);
+void       pixbufs_delete_tooltips(pixbufs_t*);
+
+/* Dial functions */
+void       set_source_usage(cairo_t*, gdouble, gboolean, const gdouble*);
+GdkPixbuf* dial_render(guint, guint, gboolean, const gdouble*);
+GdkPixbuf* dial_render_split(guint, const stats_numa_t*, gboolean,
+                             const gdouble*);
+
+#endif // XFCE4_APPLET_MEMORY_PIXBUFS_H
@@ -0,0 +1,1056 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include "stats.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Stats functions */
+static gboolean stats_read_ram(stats_files_t*, stats_t*, const meminfo_t*);
+static gboolean stats_read_swap(stats_files_t*, stats_t*, const meminfo_t*);
+static gboolean stats_read_cgroup(stats_files_t*, stats_t*, const meminfo_t*);
+static void     stats_open_cgroup(stats_files_t*, const gchar*);
+static void     stats_close_cgroup(stats_files_t*);
+static gboolean stats_read_zram(stats_files_t*, stats_t*, const meminfo_t*);
+static void     stats_open_zram(stats_files_t*, const gchar*);
+static void     stats_close_zram(stats_files_t*);
+static gboolean stats_read_numa(stats_files_t*, stats_t*, const meminfo_t*);
+static void     stats_open_numa(stats_files_t*, const gchar*);
+static void     stats_close_numa(stats_files_t*);
+static gboolean stats_read_vmstat(stats_files_t*, stats_t*, const meminfo_t*);
+static void     stats_open_vmstat(stats_files_t*, const gchar*);
+static void     stats_close_vmstat(stats_files_t*);
+static void     stats_ceiling_vmstat(stats_t*, gulong);
+static gboolean
+stats_read_meminfo(const stats_meminfo_spec_t*, stats_t*, const meminfo_t*);
+
+/* The fields of stats_t that are particular to each monitor */
+static const stats_field_t ram_stats[] = {
+    {"Free", offsetof(stats_t, ram.free)},
+    {"Buffered", offsetof(stats_t, ram.buffered)},
+    {"Cached", offsetof(stats_t, ram.cached)},
+    {NULL, 0}};
+
+static const stats_field_t swap_stats[] = {
+    {"Cached", offsetof(stats_t, swap.cached)}, {NULL, 0}};
+
+static const stats_field_t cgroup_stats[] = {
+    {"Current", offsetof(stats_t, cgroup.current)},
+    {"Swap", offsetof(stats_t, cgroup.swap)},
+    {"Anon", offsetof(stats_t, cgroup.anon)},
+    {"File", offsetof(stats_t, cgroup.file)},
+    {"Kernel", offsetof(stats_t, cgroup.kernel)},
+    {"Shmem", offsetof(stats_t, cgroup.shmem)},
+    {NULL, 0}};
+
+static const stats_field_t zram_stats[] = {
+    {"Original", offsetof(stats_t, zram.original)},
+    {"Compressed", offsetof(stats_t, zram.compressed)},
+    {"Resident", offsetof(stats_t, zram.resident)},
+    {NULL, 0}};
+
+static const stats_field_t vmstat_stats[] = {
+    {"Swap in", offsetof(stats_t, vmstat.pswpin)},
+    {"Swap out", offsetof(stats_t, vmstat.pswpout)},
+    {"Major faults", offsetof(stats_t, vmstat.pgmajfault)},
+    {"Alloc stalls", offsetof(stats_t, vmstat.allocstall)},
+    {NULL, 0}};
+
+const stats_spec_t stats_spec[stats_app.monitors] = {
+    {
+        "RAM",          /* name */
+        stats_read_ram, /* read() */
+        NULL,           /* open() */
+        NULL,           /* close() */
+        NULL,           /* ceiling() */
+        FALSE,          /* path */
+        ram_stats,      /* fields */
+        {}              /* meminfo */
+    },                  /* [STATS_RAM] */
+    {
+        "Swap",          /* name */
+        stats_read_swap, /* read() */
+        NULL,            /* open() */
+        NULL,            /* close() */
+        NULL,            /* ceiling() */
+        FALSE,           /* path */
+        swap_stats,      /* fields */
+        {}               /* meminfo */
+    },                   /* [STATS_SWAP] */
+    {
+        "Cgroup",           /* name */
+        stats_read_cgroup,  /* read() */
+        stats_open_cgroup,  /* open() */
+        stats_close_cgroup, /* close() */
+        NULL,               /* ceiling() */
+        TRUE,               /* path */
+        cgroup_stats,       /* fields */
+        {}                  /* meminfo */
+    },                      /* [STATS_CGROUP] */
+    {
+        "Shmem", /* name */
+        NULL,    /* read() */
+        NULL,    /* open() */
+        NULL,    /* close() */
+        NULL,    /* ceiling() */
+        FALSE,   /* path */
+        NULL,    /* fields */
+        {
+            {"Total", offsetof(meminfo_t, mem_total)}, /* total */
+            1,                                         /* count */
+            {{"Shmem", offsetof(meminfo_t, shmem)}}    /* parts */
+        }                                              /* meminfo */
+    },                                                 /* [STATS_SHMEM] */
+    {
+        "Dirty", /* name */
+        NULL,    /* read() */
+        NULL,    /* open() */
+        NULL,    /* close() */
+        NULL,    /* ceiling() */
+        FALSE,   /* path */
+        NULL,    /* fields */
+        {
+            {"Total", offsetof(meminfo_t, mem_total)}, /* total */
+            2,                                         /* count */
+            {
+                {"Dirty", offsetof(meminfo_t, dirty)},
+                {"Writeback", offsetof(meminfo_t, writeback)},
+            } /* parts */
+        }     /* meminfo */
+    },        /* [STATS_DIRTY] */
+    {
+        "Anon", /* name */
+        NULL,   /* read() */
+        NULL,   /* open() */
+        NULL,   /* close() */
+        NULL,   /* ceiling() */
+        FALSE,  /* path */
+        NULL,   /* fields */
+        {
+            {"Total", offsetof(meminfo_t, mem_total)},  /* total */
+            1,                                          /* count */
+            {{"Anon", offsetof(meminfo_t, anon_pages)}} /* parts */
+        }                                               /* meminfo */
+    },                                                  /* [STATS_ANON] */
+    {
+        "Mlocked", /* name */
+        NULL,      /* read() */
+        NULL,      /* open() */
+        NULL,      /* close() */
+        NULL,      /* ceiling() */
+        FALSE,     /* path */
+        NULL,      /* fields */
+        {
+            {"Total", offsetof(meminfo_t, mem_total)},  /* total */
+            1,                                          /* count */
+            {{"Mlocked", offsetof(meminfo_t, mlocked)}} /* parts */
+        }                                               /* meminfo */
+    },                                                  /* [STATS_LOCKED] */
+    {
+        "Commit", /* name */
+        NULL,     /* read() */
+        NULL,     /* open() */
+        NULL,     /* close() */
+        NULL,     /* ceiling() */
+        FALSE,    /* path */
+        NULL,     /* fields */
+        {
+            /* Committed_AS can exceed CommitLimit unless overcommit is
+               disabled. There is no headroom left when it does */
+            {"Limit", offsetof(meminfo_t, commit_limit)},      /* total */
+            1,                                                 /* count */
+            {{"Committed", offsetof(meminfo_t, committed_as)}} /* parts */
+        } /* meminfo */
+    },    /* [STATS_COMMIT] */
+    {
+        "Zram",           /* name */
+        stats_read_zram,  /* read() */
+        stats_open_zram,  /* open() */
+        stats_close_zram, /* close() */
+        NULL,             /* ceiling() */
+        FALSE,            /* path */
+        zram_stats,       /* fields */
+        {}                /* meminfo */
+    },                    /* [STATS_ZRAM] */
+    {
+        "NUMA",           /* name */
+        stats_read_numa,  /* read() */
+        stats_open_numa,  /* open() */
+        stats_close_numa, /* close() */
+        NULL,             /* ceiling() */
+        FALSE,            /* path */
+        NULL,             /* fields */
+        {}                /* meminfo */
+    },                    /* [STATS_NUMA] */
+    {
+        "Swapping",           /* name */
+        stats_read_vmstat,    /* read() */
+        stats_open_vmstat,    /* open() */
+        stats_close_vmstat,   /* close() */
+        stats_ceiling_vmstat, /* ceiling() */
+        FALSE,                /* path */
+        vmstat_stats,         /* fields */
+        {}                    /* meminfo */
+    }                         /* [STATS_VMSTAT] */
+};
+
+/* The fields of /proc/meminfo that are read into meminfo_t */
+typedef struct {
+  const gchar* key;
+  gsize        offset;
+} field_t;
+
+static constexpr field_t fields[] = {
+    {"MemTotal", offsetof(meminfo_t, mem_total)},
+    {"MemFree", offsetof(meminfo_t, mem_free)},
+    {"Buffers", offsetof(meminfo_t, buffers)},
+    {"Cached", offsetof(meminfo_t, cached)},
+    {"SwapCached", offsetof(meminfo_t, swap_cached)},
+    {"SwapTotal", offsetof(meminfo_t, swap_total)},
+    {"SwapFree", offsetof(meminfo_t, swap_free)},
+    {"Shmem", offsetof(meminfo_t, shmem)},
+    {"Dirty", offsetof(meminfo_t, dirty)},
+    {"Writeback", offsetof(meminfo_t, writeback)},
+    {"AnonPages", offsetof(meminfo_t, anon_pages)},
+    {"Mlocked", offsetof(meminfo_t, mlocked)},
+    {"CommitLimit", offsetof(meminfo_t, commit_limit)},
+    {"Committed_AS", offsetof(meminfo_t, committed_as)},
+    /* The rest are optional */
+    {"MemAvailable", offsetof(meminfo_t, mem_available)},
+    {"Zswap", offsetof(meminfo_t, zswap)},
+    {"Zswapped", offsetof(meminfo_t, zswapped)},
+};
+
+static constexpr guint fields_count    = G_N_ELEMENTS(fields);
+static constexpr guint fields_required = fields_count - 3;
+
+/* The fields of memory.stat that are read into stats_cgroup_t. The values in
+   that file are in bytes */
+static constexpr field_t cgroup_fields[] = {
+    {"anon", offsetof(stats_cgroup_t, anon)},
+    {"file", offsetof(stats_cgroup_t, file)},
+    {"kernel", offsetof(stats_cgroup_t, kernel)},
+    {"shmem", offsetof(stats_cgroup_t, shmem)},
+};
+
+/* The keys are looked up in a perfect hash table that is built at compile
+   time. The number of slots must be a power of 2 */
+static constexpr guint field_slots = 64;
+
+typedef struct {
+  gint8 slots[field_slots]; /* Index into fields[] or -1 */
+} field_index_t;
+
+/* FNV-1a. This is also computed incrementally while scanning for the ':' */
+static constexpr guint32 field_hash_init  = 2166136261u;
+static constexpr guint32 field_hash_prime = 16777619u;
+
+static constexpr guint32 field_hash_step(guint32 hash, gchar c) {
+  return (hash ^ (guchar)c) * field_hash_prime;
+}
+
+static constexpr guint32 field_hash(const gchar* key) {
+  guint32 hash = field_hash_init;
+
+  while(*key)
+    hash = field_hash_step(hash, *key++);
+  return hash;
+}
+
+static constexpr field_index_t field_index_new() {
+  field_index_t index = {};
+  guint         i     = 0;
+
+  for(i = 0; i < field_slots; i++)
+    index.slots[i] = -1;
+  for(i = 0; i < fields_count; i++)
+    index.slots[field_hash(fields[i].key) & (field_slots - 1)] = i;
+  return index;
+}
+
+static constexpr field_index_t field_index = field_index_new();
+
+static constexpr gboolean field_index_is_perfect() {
+  guint i    = 0;
+  guint slot = 0;
+
+  for(i = 0; i < fields_count; i++) {
+    slot = field_hash(fields[i].key) & (field_slots - 1);
+    if(field_index.slots[slot] != (gint)i)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static_assert(field_index_is_perfect(),
+              "Collision in the meminfo field table. Increase field_slots");
+
+/* Returns the field whose key is exactly the len bytes at key, or NULL. The
+   whole key is compared so "Cached" never matches "SwapCached" or vice
+   versa */
+static const field_t*
+field_lookup(guint32 hash, const gchar* key, gsize len) {
+  gint           slot  = field_index.slots[hash & (field_slots - 1)];
+  const field_t* field = NULL;
+
+  if(slot >= 0) {
+    field = &fields[slot];
+    if(strncmp(field->key, key, len) == 0 && field->key[len] == '\0')
+      return field;
+  }
+  return NULL;
+}
+
+/* Parses the contents of /proc/meminfo in a single pass without allocating.
+   Returns TRUE if every field in fields[] that is not optional was found.
+   The optional fields that are missing are left as they were, except for
+   MemAvailable. That is only there since 3.14 and is estimated from the
+   free memory and the caches before that */
+gboolean meminfo_parse(const gchar* buf, gsize len, meminfo_t* meminfo) {
+  const gchar*   p     = buf;
+  const gchar*   end   = buf + len;
+  const gchar*   key   = NULL;
+  const field_t* field = NULL;
+  guint32        hash  = 0;
+  gulong         value = 0;
+  guint          found = 0;
+  gboolean       avail = FALSE;
+
+  while(p < end) {
+    key  = p;
+    hash = field_hash_init;
+    while(p < end && *p != ':')
+      hash = field_hash_step(hash, *p++);
+    if(p == end)
+      break;
+
+    if((field = field_lookup(hash, key, p - key))) {
+      for(p++; p < end && *p == ' '; p++)
+        ;
+      for(value = 0; p < end && *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+      if(p + 1 < end && p[0] == ' ' && p[1] == 'k')
+        value *= 1024; /* Most values in the file are in kB */
+      *(gulong*)((gchar*)meminfo + field->offset) = value;
+      if(field < fields + fields_required)
+        found++;
+      else if(field->offset == offsetof(meminfo_t, mem_available))
+        avail = TRUE;
+    }
+
+    if(!(p = (const gchar*)memchr(p, '\n', end - p)))
+      break;
+    p++;
+  }
+
+  if(!avail)
+    meminfo->mem_available =
+        meminfo->mem_free + meminfo->buffers + meminfo->cached;
+  return found == fields_required;
+}
+
+void meminfo_reader_init(meminfo_reader_t* reader, const gchar* file) {
+  reader->fd   = -1;
+  reader->file = file;
+}
+
+gboolean meminfo_reader_read(meminfo_reader_t* reader, meminfo_t* meminfo) {
+  ssize_t len = 0;
+
+  if(reader->fd < 0)
+    reader->fd = open(reader->file ? reader->file : stats_app.meminfo,
+                      O_RDONLY | O_CLOEXEC);
+  if(reader->fd < 0)
+    return FALSE;
+
+  if((len = pread(reader->fd, reader->buf, sizeof(reader->buf), 0)) <= 0) {
+    meminfo_reader_close(reader);
+    return FALSE;
+  }
+
+  return meminfo_parse(reader->buf, len, meminfo);
+}
+
+void meminfo_reader_close(meminfo_reader_t* reader) {
+  if(reader->fd >= 0)
+    close(reader->fd);
+  reader->fd = -1;
+}
+
+guint get_percent(gulong total, gulong available) {
+  if(total)
+    return (total - available) * 100 / total;
+  return 0;
+}
+
+/* In hundredths of a percent */
+guint32 get_value(gulong total, gulong available) {
+  if(total)
+    return (gdouble)(total - available) * 10000 / total;
+  return 0;
+}
+
+static gboolean
+stats_read_ram(stats_files_t*, stats_t* stats, const meminfo_t* meminfo) {
+  if(!meminfo)
+    return FALSE;
+
+  stats->total        = meminfo->mem_total;
+  stats->available    = meminfo->mem_available;
+  stats->ram.free     = meminfo->mem_free;
+  stats->ram.buffered = meminfo->buffers;
+  stats->ram.cached   = meminfo->cached;
+
+  return TRUE;
+}
+
+static gboolean
+stats_read_swap(stats_files_t*, stats_t* stats, const meminfo_t* meminfo) {
+  if(!meminfo)
+    return FALSE;
+
+  stats->total       = meminfo->swap_total;
+  stats->available   = meminfo->swap_free;
+  stats->swap.cached = meminfo->swap_cached;
+
+  return TRUE;
+}
+
+static gulong meminfo_get(const meminfo_t* meminfo, gsize offset) {
+  return *(const gulong*)((const gchar*)meminfo + offset);
+}
+
+static gboolean stats_read_meminfo(const stats_meminfo_spec_t* spec,
+                                   stats_t*                    stats,
+                                   const meminfo_t*            meminfo) {
+  gulong used = 0;
+  guint  i    = 0;
+
+  for(i = 0; i < spec->count; i++) {
+    stats->meminfo.parts[i] = meminfo_get(meminfo, spec->parts[i].offset);
+    used += stats->meminfo.parts[i];
+  }
+  stats->total     = meminfo_get(meminfo, spec->total.offset);
+  stats->available = stats->total > used ? stats->total - used : 0;
+
+  return TRUE;
+}
+
+static int cgroup_open_file(const gchar* dir, const gchar* name) {
+  gchar* file = g_build_filename(dir, name, NULL);
+  int    fd   = open(file, O_RDONLY | O_CLOEXEC);
+
+  g_free(file);
+  return fd;
+}
+
+static void cgroup_close(cgroup_t* cgroup) {
+  guint i = 0;
+
+  if(cgroup->current >= 0)
+    close(cgroup->current);
+  if(cgroup->swap >= 0)
+    close(cgroup->swap);
+  if(cgroup->stat >= 0)
+    close(cgroup->stat);
+  for(i = 0; i < cgroup->limits_count; i++)
+    if(cgroup->limits[i] >= 0)
+      close(cgroup->limits[i]);
+  cgroup->current      = -1;
+  cgroup->swap         = -1;
+  cgroup->stat         = -1;
+  cgroup->limits_count = 0;
+}
+
+/* The limits of every ancestor also apply to the cgroup, so those files are
+   opened as well */
+static void cgroup_open(cgroup_t* cgroup, const gchar* path) {
+  gchar* dir    = NULL;
+  gchar* parent = NULL;
+  gsize  root   = strlen(stats_app.cgroup.root);
+
+  dir = g_build_filename(stats_app.cgroup.root, path, NULL);
+  while(strlen(dir) > root && dir[strlen(dir) - 1] == '/')
+    dir[strlen(dir) - 1] = '\0';
+
+  cgroup->current      = cgroup_open_file(dir, "memory.current");
+  cgroup->swap         = cgroup_open_file(dir, "memory.swap.current");
+  cgroup->stat         = cgroup_open_file(dir, "memory.stat");
+  cgroup->limits_count = 0;
+  while(strlen(dir) > root &&
+        cgroup->limits_count < stats_app.cgroup.depth * 2) {
+    cgroup->limits[cgroup->limits_count++] =
+        cgroup_open_file(dir, "memory.max");
+    cgroup->limits[cgroup->limits_count++] =
+        cgroup_open_file(dir, "memory.high");
+    parent = g_path_get_dirname(dir);
+    g_free(dir);
+    dir = parent;
+  }
+  g_free(dir);
+}
+
+/* Reads a file containing a single value which is either a number of bytes
+   or "max" */
+static gboolean cgroup_read_value(cgroup_t* cgroup, int fd, gulong* value) {
+  const gchar* p   = cgroup->buf;
+  const gchar* end = NULL;
+  ssize_t      len = 0;
+
+  if(fd < 0 || (len = pread(fd, cgroup->buf, 32, 0)) <= 0)
+    return FALSE;
+
+  end = p + len;
+  if(len >= 3 && strncmp(p, "max", 3) == 0) {
+    *value = G_MAXULONG;
+    return TRUE;
+  }
+  for(*value = 0; p < end && *p >= '0' && *p <= '9'; p++)
+    *value = *value * 10 + (*p - '0');
+  return p > cgroup->buf;
+}
+
+/* Parses the lines of memory.stat that are in cgroup_fields[]. Every line is
+   a key and a value separated by a space */
+static void cgroup_read_stat(cgroup_t* cgroup, stats_cgroup_t* stats) {
+  const gchar* p     = cgroup->buf;
+  const gchar* end   = NULL;
+  const gchar* key   = NULL;
+  gulong*      value = NULL;
+  ssize_t      len   = 0;
+  guint        i     = 0;
+
+  for(i = 0; i < G_N_ELEMENTS(cgroup_fields); i++)
+    *(gulong*)((gchar*)stats + cgroup_fields[i].offset) = 0;
+  if(cgroup->stat < 0 ||
+     (len = pread(cgroup->stat, cgroup->buf, sizeof(cgroup->buf), 0)) <= 0)
+    return;
+
+  end = p + len;
+  while(p < end) {
+    key = p;
+    if(!(p = (const gchar*)memchr(p, ' ', end - p)))
+      break;
+    for(i = 0, value = NULL; !value && i < G_N_ELEMENTS(cgroup_fields); i++)
+      if(strncmp(cgroup_fields[i].key, key, p - key) == 0 &&
+         cgroup_fields[i].key[p - key] == '\0')
+        value = (gulong*)((gchar*)stats + cgroup_fields[i].offset);
+    if(value)
+      for(p++, *value = 0; p < end && *p >= '0' && *p <= '9'; p++)
+        *value = *value * 10 + (*p - '0');
+
+    if(!(p = (const gchar*)memchr(p, '\n', end - p)))
+      break;
+    p++;
+  }
+}
+
+static void stats_open_cgroup(stats_files_t* files, const gchar* path) {
+  cgroup_open(&files->cgroup, path);
+}
+
+static void stats_close_cgroup(stats_files_t* files) {
+  cgroup_close(&files->cgroup);
+}
+
+/* The percentage is computed against the effective limit. That is the lowest
+   memory.max or memory.high of the cgroup and its ancestors, or the total
+   memory if none of them is set. Without meminfo, there is no total memory
+   to fall back on */
+static gboolean stats_read_cgroup(stats_files_t*   files,
+                                  stats_t*         stats,
+                                  const meminfo_t* meminfo) {
+  stats_cgroup_t* cgroup = &stats->cgroup;
+  cgroup_t*       group  = &files->cgroup;
+  gulong          limit  = meminfo ? meminfo->mem_total : G_MAXULONG;
+  gulong          value  = 0;
+  guint           i      = 0;
+
+  if(!cgroup_read_value(group, group->current, &cgroup->current))
+    return FALSE;
+  for(i = 0; i < group->limits_count; i++)
+    if(cgroup_read_value(group, group->limits[i], &value))
+      limit = MIN(limit, value);
+  if(!cgroup_read_value(group, group->swap, &cgroup->swap))
+    cgroup->swap = 0;
+  cgroup_read_stat(group, cgroup);
+  if(limit == G_MAXULONG)
+    return FALSE;
+
+  stats->total     = limit;
+  stats->available = limit > cgroup->current ? limit - cgroup->current : 0;
+
+  return TRUE;
+}
+
+static void zram_close(zram_t* zram) {
+  guint i = 0;
+
+  for(i = 0; i < zram->count; i++)
+    close(zram->fds[i]);
+  zram->count = 0;
+}
+
+/* Devices that are added after this are not seen until the monitor is
+   opened again */
+static void zram_open(zram_t* zram) {
+  GDir*        dir  = NULL;
+  const gchar* name = NULL;
+  gchar*       file = NULL;
+  int          fd   = -1;
+
+  zram->count = 0;
+  if(!(dir = g_dir_open(stats_app.zram.root, 0, NULL)))
+    return;
+  while((name = g_dir_read_name(dir)) &&
+        zram->count < stats_app.zram.devices) {
+    if(!g_str_has_prefix(name, stats_app.zram.prefix))
+      continue;
+    file = g_build_filename(stats_app.zram.root, name, stats_app.zram.file,
+                            NULL);
+    if((fd = open(file, O_RDONLY | O_CLOEXEC)) >= 0)
+      zram->fds[zram->count++] = fd;
+    g_free(file);
+  }
+  g_dir_close(dir);
+}
+
+/* The first three fields of mm_stat are the original size, the compressed
+   size and the total memory used by the device, all in bytes */
+static gboolean zram_read(zram_t* zram, int fd, gulong* values, guint count) {
+  const gchar* p   = zram->buf;
+  const gchar* end = NULL;
+  ssize_t      len = 0;
+  guint        i   = 0;
+
+  if((len = pread(fd, zram->buf, sizeof(zram->buf), 0)) <= 0)
+    return FALSE;
+
+  end = p + len;
+  for(i = 0; i < count; i++) {
+    for(; p < end && *p == ' '; p++)
+      ;
+    if(p == end || *p < '0' || *p > '9')
+      return FALSE;
+    for(values[i] = 0; p < end && *p >= '0' && *p <= '9'; p++)
+      values[i] = values[i] * 10 + (*p - '0');
+  }
+  return TRUE;
+}
+
+static void stats_open_zram(stats_files_t* files, const gchar*) {
+  zram_open(&files->zram);
+}
+
+static void stats_close_zram(stats_files_t* files) {
+  zram_close(&files->zram);
+}
+
+/* The dial shows how much of the RAM is taken up by compressed swap. That
+   is what the swap is really costing, unlike SwapTotal and SwapFree which
+   count the pages before they were compressed */
+static gboolean stats_read_zram(stats_files_t*   files,
+                                stats_t*         stats,
+                                const meminfo_t* meminfo) {
+  stats_zram_t* zram   = &stats->zram;
+  zram_t*       device = &files->zram;
+  gulong        values[3];
+  guint         i = 0;
+
+  if(!meminfo)
+    return FALSE;
+
+  zram->original   = meminfo->zswapped;
+  zram->compressed = meminfo->zswap;
+  zram->resident   = meminfo->zswap;
+  for(i = 0; i < device->count; i++) {
+    if(zram_read(device, device->fds[i], values, 3)) {
+      zram->original += values[0];
+      zram->compressed += values[1];
+      zram->resident += values[2];
+    }
+  }
+
+  stats->total     = meminfo->mem_total;
+  stats->available = stats->total > zram->resident
+                         ? stats->total - zram->resident
+                         : 0;
+
+  return TRUE;
+}
+
+static void numa_close(numa_t* numa) {
+  guint i = 0;
+
+  for(i = 0; i < numa->count; i++)
+    close(numa->fds[i]);
+  numa->count = 0;
+  numa->found = 0;
+}
+
+/* The directory is not in any particular order, so every node is looked at
+   and only the lowest ids are kept before any file is opened */
+static void numa_scan(numa_t* numa) {
+  GDir*        dir  = NULL;
+  const gchar* name = NULL;
+  const gchar* id   = NULL;
+  gchar*       end  = NULL;
+  guint        node = 0;
+  guint        i    = 0;
+
+  numa->count = 0;
+  numa->found = 0;
+  if(!(dir = g_dir_open(stats_app.numa.root, 0, NULL)))
+    return;
+  while((name = g_dir_read_name(dir))) {
+    if(!g_str_has_prefix(name, stats_app.numa.prefix))
+      continue;
+    id   = name + strlen(stats_app.numa.prefix);
+    node = strtoul(id, &end, 10);
+    if(end == id || *end)
+      continue;
+    numa->found++;
+    if(numa->count == stats_app.numa.nodes &&
+       numa->ids[numa->count - 1] < node)
+      continue;
+    /* When there is no room left, the highest id is pushed out */
+    if(numa->count < stats_app.numa.nodes)
+      numa->count++;
+    for(i = numa->count - 1; i > 0 && numa->ids[i - 1] > node; i--)
+      numa->ids[i] = numa->ids[i - 1];
+    numa->ids[i] = node;
+  }
+  g_dir_close(dir);
+}
+
+/* The nodes are only discovered when the monitor is opened. They are kept in
+   ascending order of their id. A node whose file cannot be opened is left
+   out but still counts as found */
+static void numa_open(numa_t* numa) {
+  gchar  name[32];
+  gchar* file  = NULL;
+  guint  count = 0;
+  guint  i     = 0;
+  int    fd    = -1;
+
+  numa_scan(numa);
+  for(i = 0, count = numa->count, numa->count = 0; i < count; i++) {
+    g_snprintf(name, sizeof(name), "%s%u", stats_app.numa.prefix,
+               numa->ids[i]);
+    file = g_build_filename(stats_app.numa.root, name, stats_app.numa.file,
+                            NULL);
+    if((fd = open(file, O_RDONLY | O_CLOEXEC)) >= 0) {
+      numa->ids[numa->count]   = numa->ids[i];
+      numa->fds[numa->count++] = fd;
+    }
+    g_free(file);
+  }
+}
+
+/* Every line of the file starts with "Node <id>" followed by the same keys
+   as /proc/meminfo */
+static gulong numa_get_field(const gchar* buf, const gchar* key) {
+  const gchar* p = strstr(buf, key);
+
+  if(!p)
+    return 0;
+  for(p += strlen(key); *p == ' '; p++)
+    ;
+  return strtoul(p, NULL, 10) * 1024;
+}
+
+static gboolean numa_read(numa_t* numa, int fd, numa_node_t* node) {
+  ssize_t len = 0;
+
+  if((len = pread(fd, numa->buf, sizeof(numa->buf) - 1, 0)) <= 0)
+    return FALSE;
+
+  numa->buf[len] = '\0';
+  node->total    = numa_get_field(numa->buf, " MemTotal:");
+  node->free     = numa_get_field(numa->buf, " MemFree:");
+  return node->total > 0;
+}
+
+static void stats_open_numa(stats_files_t* files, const gchar*) {
+  numa_open(&files->numa);
+}
+
+static void stats_close_numa(stats_files_t* files) {
+  numa_close(&files->numa);
+}
+
+/* There is no MemAvailable for a node. MemFree is what the allocator checks
+   before it falls back to another node, so that is used instead */
+static gboolean
+stats_read_numa(stats_files_t* files, stats_t* stats, const meminfo_t*) {
+  stats_numa_t* numa  = &stats->numa;
+  numa_t*       nodes = &files->numa;
+  numa_node_t*  node  = NULL;
+  guint32       value = 0;
+  guint32       worst = 0;
+  guint         i     = 0;
+
+  numa->worst = 0;
+  numa->count = nodes->count;
+  numa->found = nodes->found;
+  for(i = 0; i < nodes->count; i++) {
+    node         = &numa->nodes[i];
+    numa->ids[i] = nodes->ids[i];
+    if(!numa_read(nodes, nodes->fds[i], node))
+      node->total = node->free = 0;
+    if((value = get_value(node->total, node->free)) > worst) {
+      worst       = value;
+      numa->worst = i;
+    }
+  }
+  if(!numa->count)
+    return FALSE;
+
+  stats->total     = numa->nodes[numa->worst].total;
+  stats->available = numa->nodes[numa->worst].free;
+
+  return TRUE;
+}
+
+static void stats_open_vmstat(stats_files_t* files, const gchar*) {
+  vmstat_t* vmstat = &files->vmstat;
+
+  memset(vmstat, 0, sizeof(vmstat_t));
+  vmstat->fd   = open(stats_app.vmstat.file, O_RDONLY | O_CLOEXEC);
+  vmstat->size = stats_app.vmstat.buffer;
+  vmstat->buf  = (gchar*)g_malloc(vmstat->size);
+}
+
+static void stats_close_vmstat(stats_files_t* files) {
+  vmstat_t* vmstat = &files->vmstat;
+
+  if(vmstat->fd >= 0)
+    close(vmstat->fd);
+  g_free(vmstat->buf);
+  vmstat->fd   = -1;
+  vmstat->buf  = NULL;
+  vmstat->size = 0;
+}
+
+/* Reads the whole file, however large it is. Returns the number of bytes
+   read or -1 on error */
+static gssize vmstat_fill(vmstat_t* file) {
+  gsize   len  = 0;
+  ssize_t size = 0;
+
+  while((size = pread(file->fd, file->buf + len, file->size - len, len)) > 0)
+    if((len += size) == file->size) {
+      file->size *= 2;
+      file->buf = (gchar*)g_realloc(file->buf, file->size);
+    }
+  return size < 0 ? -1 : (gssize)len;
+}
+
+static void vmstat_update_total(stats_t* stats) {
+  stats_vmstat_t* vmstat = &stats->vmstat;
+  gulong          used   = 0;
+
+  used = vmstat->pswpin + vmstat->pswpout + vmstat->pgmajfault
+         + vmstat->allocstall;
+  stats->total     = vmstat->ceiling;
+  stats->available = stats->total - MIN(used, stats->total);
+}
+
+/* The rates that were last read are scaled to the new ceiling right away so
+   that nothing is drawn against the old one until the next read */
+static void stats_ceiling_vmstat(stats_t* stats, gulong ceiling) {
+  stats->vmstat.ceiling = MAX(ceiling, 1ul);
+  vmstat_update_total(stats);
+}
+
+/* Every line is a key and a counter separated by a single space. The lines
+   are walked once and only the first character of the key is compared
+   before the rest of it, since almost none of them are wanted */
+static gboolean vmstat_read(vmstat_t* file, vmstat_counters_t* counters) {
+  const gchar* p     = NULL;
+  const gchar* end   = NULL;
+  const gchar* key   = NULL;
+  gsize        len   = 0;
+  guint64      value = 0;
+  gssize       size  = 0;
+
+  if(file->fd < 0)
+    return FALSE;
+  if((size = vmstat_fill(file)) <= 0)
+    return FALSE;
+
+  memset(counters, 0, sizeof(vmstat_counters_t));
+  p   = file->buf;
+  end = file->buf + size;
+  while(p < end) {
+    for(key = p; p < end && *p != ' ' && *p != '\n'; p++)
+      ;
+    /* A line without a counter is skipped */
+    len = p < end && *p == ' ' ? p - key : 0;
+    if(len)
+      p++;
+    for(value = 0; p < end && *p >= '0' && *p <= '9'; p++)
+      value = value * 10 + (*p - '0');
+    for(; p < end && *p++ != '\n';)
+      ;
+
+    if(*key != 'p' && *key != 'a')
+      continue;
+    else if(len == 6 && !strncmp(key, "pswpin", len))
+      counters->pswpin = value;
+    else if(len == 7 && !strncmp(key, "pswpout", len))
+      counters->pswpout = value;
+    else if(len == 10 && !strncmp(key, "pgmajfault", len))
+      counters->pgmajfault = value;
+    else if(len >= 10 && !strncmp(key, "allocstall", 10))
+      counters->allocstall += value;
+  }
+  return TRUE;
+}
+
+/* The rate since the last read. The counters are never reset but they are
+   only consistent with each other within a read, so a counter that went
+   backwards is taken to be 0 */
+static gulong vmstat_get_rate(guint64 now, guint64 then, gdouble dt) {
+  return now > then ? (gulong)((now - then) / dt + 0.5) : 0;
+}
+
+/* The rates are all 0 after the first read since there is nothing to take
+   the difference with. They are left as they were if no time has passed */
+static gboolean
+stats_read_vmstat(stats_files_t* files, stats_t* stats, const meminfo_t*) {
+  stats_vmstat_t*   vmstat   = &stats->vmstat;
+  vmstat_t*         file     = &files->vmstat;
+  vmstat_counters_t counters = {};
+  gint64            time     = g_get_monotonic_time();
+  gdouble           dt       = (time - file->time) / 1e6;
+
+  if(!vmstat_read(file, &counters))
+    return FALSE;
+
+  if(!file->time) {
+    vmstat->pswpin     = 0;
+    vmstat->pswpout    = 0;
+    vmstat->pgmajfault = 0;
+    vmstat->allocstall = 0;
+  } else if(dt > 0) {
+    vmstat->pswpin     = vmstat_get_rate(counters.pswpin,
+                                         file->counters.pswpin, dt);
+    vmstat->pswpout    = vmstat_get_rate(counters.pswpout,
+                                         file->counters.pswpout, dt);
+    vmstat->pgmajfault = vmstat_get_rate(counters.pgmajfault,
+                                         file->counters.pgmajfault, dt);
+    vmstat->allocstall = vmstat_get_rate(counters.allocstall,
+                                         file->counters.allocstall, dt);
+  }
+  file->counters = counters;
+  file->time     = time;
+  vmstat_update_total(stats);
+
+  return TRUE;
+}
+
+/* Every monitor is read from the same meminfo_t so however many of them are
+   enabled, /proc/meminfo is only parsed once per tick */
+gboolean stats_read(guint            id,
+                    stats_files_t*   files,
+                    stats_t*         stats,
+                    const meminfo_t* meminfo) {
+  const stats_spec_t* spec = &stats_spec[id];
+
+  if(spec->read)
+    return spec->read(files, stats, meminfo);
+  return meminfo && stats_read_meminfo(&spec->meminfo, stats, meminfo);
+}
+
+/* The nodes have no fixed place in stats_t so the memory used on each of
+   them is reported under the name of the node */
+void stats_foreach_field(guint              id,
+                         const stats_t*     stats,
+                         stats_field_func_t func,
+                         void*              data) {
+  const stats_spec_t*  spec  = &stats_spec[id];
+  const stats_field_t* field = NULL;
+  const stats_numa_t*  numa  = &stats->numa;
+  gchar                label[32];
+  guint                i = 0;
+
+  for(field = spec->fields; field && field->label; field++)
+    func(field->label,
+         *(const gulong*)((const gchar*)stats + field->offset), data);
+  if(!spec->read)
+    for(i = 0; i < spec->meminfo.count; i++)
+      func(spec->meminfo.parts[i].label, stats->meminfo.parts[i], data);
+  if(id == STATS_NUMA)
+    for(i = 0; i < numa->count; i++) {
+      g_snprintf(label, sizeof(label), "%s%u", stats_app.numa.prefix,
+                 numa->ids[i]);
+      func(label, numa->nodes[i].total - numa->nodes[i].free, data);
+    }
+}
+
+void trend_reset(trend_t* trend) {
+  memset(trend, 0, sizeof(trend_t));
+}
+
+/* Moving every time in the sums back by dt and decaying every weight takes
+   a constant number of operations however many samples have been seen */
+void trend_push(trend_t* trend, gint64 time, gulong used) {
+  gdouble dt    = (time - trend->time) / 1e6;
+  gdouble decay = 0;
+
+  if(!trend->time) {
+    trend->average = used;
+    trend->w       = 1;
+    trend->y       = used;
+    trend->time    = time;
+    return;
+  }
+  if(dt <= 0)
+    return;
+
+  trend->tt = trend->tt - 2 * dt * trend->t + dt * dt * trend->w;
+  trend->ty = trend->ty - dt * trend->y;
+  trend->t  = trend->t - dt * trend->w;
+
+  decay = exp(-dt / stats_app.trend.window);
+  trend->w  = trend->w * decay + 1;
+  trend->t  = trend->t * decay;
+  trend->tt = trend->tt * decay;
+  trend->y  = trend->y * decay + used;
+  trend->ty = trend->ty * decay;
+
+  decay          = exp(-dt / stats_app.trend.smoothing);
+  trend->average = trend->average * decay + used * (1 - decay);
+  trend->time    = time;
+}
+
+/* The slope of the regression in bytes/s. This is 0 until there are at
+   least two samples to fit a line through */
+gdouble trend_get_rate(const trend_t* trend) {
+  gdouble det = trend->w * trend->tt - trend->t * trend->t;
+
+  if(det <= 1e-9)
+    return 0;
+  return (trend->w * trend->ty - trend->t * trend->y) / det;
+}
+
+/* The time (s) until the line fitted by the regression reaches total, or
+   a negative value if the memory used is not growing */
+gdouble trend_get_exhaustion(const trend_t* trend, gulong total) {
+  gdouble rate = trend_get_rate(trend);
+  gdouble now  = 0;
+
+  if(rate <= 0)
+    return -1;
+
+  /* The value of the fitted line at the time of the last sample */
+  now = (trend->y - rate * trend->t) / trend->w;
+  return MAX(0.0, (total - now) / rate);
+}
@@ -0,0 +1,333 @@
+#ifndef XFCE4_APPLET_MEMORY_STATS_H
+#define XFCE4_APPLET_MEMORY_STATS_H
+
+/* The stats engine. This reads /proc/meminfo, the cgroup files, the zram
+   devices and the NUMA nodes and turns them into the numbers shown by the
+   monitors. It only depends on GLib so that it can be shared by the plugin
+   and the command line tool */
+
+#include <glib.h>
+
+/* The constants used by the stats engine */
+typedef struct {
+  const guint  monitors;
+  const gchar* meminfo;
+  struct {
+    const gchar* root;
+    const guint  depth; /* Number of ancestors whose limits are checked */
+  } cgroup;
+  struct {
+    const gchar* root;
+    const gchar* prefix;
+    const gchar* file;
+    const guint  devices; /* Most devices that are read */
+  } zram;
+  struct {
+    const gchar* root;
+    const gchar* prefix;
+    const gchar* file;
+    const guint  nodes; /* Most nodes that are read */
+  } numa;
+  struct {
+    const gchar* file;
+    const gulong ceiling; /* Default events per second at which it is full */
+    const gsize  buffer;  /* Initial size of the buffer. It grows as needed */
+  } vmstat;
+  struct {
+    const gdouble window;    /* Time constant (s) of the regression */
+    const gdouble smoothing; /* Time constant (s) of the moving average */
+  } trend;
+} stats_app_t;
+
+static constexpr stats_app_t stats_app = {
+    11,              /* 11 monitors, see stats_spec[] */
+    "/proc/meminfo", /* meminfo */
+    {
+        "/sys/fs/cgroup", /* root */
+        16                /* depth */
+    },                    /* cgroup */
+    {
+        "/sys/block", /* root */
+        "zram",       /* prefix */
+        "mm_stat",    /* file */
+        16            /* devices */
+    },                /* zram */
+    {
+        "/sys/devices/system/node", /* root */
+        "node",                     /* prefix */
+        "meminfo",                  /* file */
+        8                           /* nodes */
+    },                              /* numa */
+    {
+        "/proc/vmstat", /* file */
+        1000,           /* ceiling */
+        8192            /* buffer */
+    },                  /* vmstat */
+    {
+        30.0, /* window */
+        5.0   /* smoothing */
+    }         /* trend */
+};
+
+/* The monitors in stats_spec[] */
+static const guint STATS_RAM    = 0;
+static const guint STATS_SWAP   = 1;
+static const guint STATS_CGROUP = 2;
+static const guint STATS_SHMEM  = 3;
+static const guint STATS_DIRTY  = 4;
+static const guint STATS_ANON   = 5;
+static const guint STATS_LOCKED = 6;
+static const guint STATS_COMMIT = 7;
+static const guint STATS_ZRAM   = 8;
+static const guint STATS_NUMA   = 9;
+static const guint STATS_VMSTAT = 10;
+
+/* The fields of /proc/meminfo that are used by any of the monitors. This is
+   filled in once per tick by the sampler and shared by all the monitors */
+typedef struct {
+  gulong mem_total;
+  gulong mem_free;
+  gulong mem_available;
+  gulong buffers;
+  gulong cached;
+  gulong swap_total;
+  gulong swap_free;
+  gulong swap_cached;
+  gulong shmem;
+  gulong dirty;
+  gulong writeback;
+  gulong anon_pages;
+  gulong mlocked;
+  gulong commit_limit;
+  gulong committed_as;
+  gulong zswap;    /* Compressed size. Only on 5.19 and later */
+  gulong zswapped; /* Uncompressed size. Only on 5.19 and later */
+} meminfo_t;
+
+/* Reads /proc/meminfo. The file is kept open and re-read with pread() */
+typedef struct {
+  int          fd;
+  const gchar* file; /* Read instead of stats_app.meminfo if set */
+  gchar        buf[4096];
+} meminfo_reader_t;
+
+typedef struct {
+  gulong free;
+  gulong buffered;
+  gulong cached;
+} stats_dram_t;
+
+typedef struct {
+  gulong cached;
+} stats_swap_t;
+
+/* The files of a cgroup that are read on every tick. They are kept open and
+   each one is re-read with a single pread(). Any of them may be -1 if the
+   file does not exist */
+typedef struct {
+  int   current;
+  int   swap; /* Missing if swap accounting is disabled */
+  int   stat;
+  int   limits[2 * stats_app.cgroup.depth]; /* memory.{max,high} to the root */
+  guint limits_count;
+  gchar buf[4096];
+} cgroup_t;
+
+typedef struct {
+  gulong current;
+  gulong swap;
+  gulong anon;
+  gulong file;
+  gulong kernel;
+  gulong shmem;
+} stats_cgroup_t;
+
+/* The mm_stat file of every zram device. Like the cgroup files, these are
+   kept open and re-read with pread() */
+typedef struct {
+  int   fds[stats_app.zram.devices];
+  guint count;
+  gchar buf[256];
+} zram_t;
+
+/* Compressed swap, both zram and zswap. The sizes are in bytes */
+typedef struct {
+  gulong original;   /* Size of the data before it was compressed */
+  gulong compressed; /* Size of the data after it was compressed */
+  gulong resident;   /* Memory used, including the allocator overhead */
+} stats_zram_t;
+
+/* The meminfo file of every NUMA node, kept open like the zram devices. If
+   there are more nodes than stats_app.numa.nodes, only the ones with the
+   lowest ids are read */
+typedef struct {
+  int   fds[stats_app.numa.nodes];
+  guint ids[stats_app.numa.nodes]; /* In ascending order */
+  guint count;
+  guint found; /* Number of nodes on the system */
+  gchar buf[4096];
+} numa_t;
+
+typedef struct {
+  gulong total;
+  gulong free;
+} numa_node_t;
+
+/* The total and available memory in stats_t are those of the node with the
+   highest percentage used, since that is the one that will start allocating
+   remotely first. The nodes are those of numa_t at the time of the read */
+typedef struct {
+  numa_node_t nodes[stats_app.numa.nodes];
+  guint       ids[stats_app.numa.nodes];
+  guint       count;
+  guint       found;
+  guint       worst;
+} stats_numa_t;
+
+/* The counters of /proc/vmstat that are used. These only ever go up */
+typedef struct {
+  guint64 pswpin;
+  guint64 pswpout;
+  guint64 pgmajfault;
+  guint64 allocstall; /* Sum of allocstall_* over all the zones */
+} vmstat_counters_t;
+
+/* /proc/vmstat, kept open like /proc/meminfo. It is parsed in a single pass
+   since it has a few hundred lines of which only a handful are wanted. The
+   file keeps growing with new kernels, so the buffer is doubled whenever it
+   is filled and is then kept at that size. The counters of the last read
+   are kept to take the rates against */
+typedef struct {
+  int               fd;
+  gchar*            buf;
+  gsize             size;
+  gint64            time; /* Monotonic time (us) of the last read, 0 if none */
+  vmstat_counters_t counters;
+} vmstat_t;
+
+/* Paging activity. Unlike the other monitors, this is a rate and not a size.
+   The rates are in events per second over the time since the last read. The
+   total is the ceiling, which is the rate at which the monitor is full, and
+   the available is whatever is left of it once all the rates are added */
+typedef struct {
+  gulong pswpin;
+  gulong pswpout;
+  gulong pgmajfault;
+  gulong allocstall;
+  gulong ceiling;
+} stats_vmstat_t;
+
+/* What a monitor keeps from one read to the next: the files it keeps open,
+   the buffers they are read into and whatever the next read is taken
+   against. These belong to whoever reads the monitor and are never copied */
+typedef struct {
+  union {
+    cgroup_t cgroup;
+    zram_t   zram;
+    numa_t   numa;
+    vmstat_t vmstat;
+  };
+} stats_files_t;
+
+/* The number of fields of meminfo_t that may be summed by a monitor */
+static const guint STATS_PARTS = 2;
+
+/* The fields that were summed by a monitor that is described by a
+   stats_meminfo_spec_t, in the same order */
+typedef struct {
+  gulong parts[STATS_PARTS];
+} stats_meminfo_t;
+
+/* Only the numbers that were read, so that it is cheap to copy */
+typedef struct {
+  gulong total;
+  gulong available;
+  union {
+    stats_dram_t    ram;
+    stats_swap_t    swap;
+    stats_cgroup_t  cgroup;
+    stats_meminfo_t meminfo;
+    stats_zram_t    zram;
+    stats_numa_t    numa;
+    stats_vmstat_t  vmstat;
+  };
+} stats_t;
+
+typedef struct {
+  const gchar* label;
+  gsize        offset; /* Of the field in meminfo_t or stats_t */
+} stats_field_t;
+
+/* A monitor that needs nothing more than some of the fields of meminfo_t.
+   The used memory is the sum of the parts */
+typedef struct {
+  stats_field_t total;
+  guint         count; /* Number of parts */
+  stats_field_t parts[STATS_PARTS];
+} stats_meminfo_spec_t;
+
+/* How each monitor gets its stats */
+typedef struct {
+  const gchar* name;
+  /* If this is NULL, the monitor is read using meminfo */
+  gboolean (*read)(stats_files_t*, stats_t*, const meminfo_t*);
+  /* Only monitors that keep files open have these */
+  void (*open)(stats_files_t*, const gchar*);
+  void (*close)(stats_files_t*);
+  /* Only monitors whose total is a ceiling on a rate have this */
+  void (*ceiling)(stats_t*, gulong);
+  const gboolean       path; /* Whether open() takes the path of a cgroup */
+  /* In stats_t and terminated by a NULL label */
+  const stats_field_t* fields;
+  stats_meminfo_spec_t meminfo;
+} stats_spec_t;
+
+extern const stats_spec_t stats_spec[stats_app.monitors];
+
+/* Meminfo functions */
+gboolean meminfo_parse(const gchar*, gsize, meminfo_t*);
+void     meminfo_reader_init(meminfo_reader_t*, const gchar*);
+gboolean meminfo_reader_read(meminfo_reader_t*, meminfo_t*);
+void     meminfo_reader_close(meminfo_reader_t*);
+
+/* A streaming estimate of where the memory used by a monitor is heading.
+   The samples are not kept. Instead, a linear regression of the memory used
+   against time is done over exponentially weighted sums whose weights decay
+   with a time constant of stats_app.trend.window, which behaves like a
+   sliding window. Since the weights depend on the time between samples
+   rather than on their number, the period of a monitor may change freely.
+   The times in the sums are relative to the last sample */
+typedef struct {
+  gint64  time;    /* Monotonic time (us) of the last sample, 0 if none */
+  gdouble average; /* Exponential moving average of the memory used */
+  gdouble w;       /* Sum of the weights */
+  gdouble t;       /* Weighted sum of the times (s) */
+  gdouble tt;      /* Weighted sum of the squares of the times */
+  gdouble y;       /* Weighted sum of the memory used */
+  gdouble ty;      /* Weighted sum of the products of time and memory used */
+} trend_t;
+
+typedef void (*stats_field_func_t)(const gchar*, gulong, void*);
+
+/* Stats functions */
+/* The meminfo is NULL if /proc/meminfo could not be read. Only the monitors
+   that do not depend on it can be read then. The files are only used by the
+   monitors that have an open(), and may be NULL for the others */
+gboolean stats_read(guint, stats_files_t*, stats_t*, const meminfo_t*);
+/* Calls the function with the label and value of every field of the stats
+   of a monitor other than the total and available memory */
+void stats_foreach_field(guint, const stats_t*, stats_field_func_t, void*);
+
+/* Trend functions */
+void    trend_reset(trend_t*);
+void    trend_push(trend_t*, gint64, gulong);
+gdouble trend_get_rate(const trend_t*);
+gdouble trend_get_exhaustion(const trend_t*, gulong);
+
+/* The percentage used */
+guint get_percent(gulong, gulong);
+
+/* The percentage used in hundredths of a percent */
+guint32 get_value(gulong, gulong);
+
+#endif // XFCE4_APPLET_MEMORY_STATS_H